@@ -27,12 +27,15 @@ using namespace nlohmann;
 
 struct fake_model{
     struct state_t{
-        friend void to_json(json& i, const state_t& m){}
-        friend void from_json(const json& j, state_t& m){}
+        friend void to_json(json& i, const state_t& m){i["done"]=m.done;}
+        friend void from_json(const json& j, state_t& m){m.done=j.value("done",false);}
+        friend void serialize(json_writer& w, const state_t& m){w.begin_object().key("done").value(m.done).end_object();}
 
         state_t(){}
 
-        state_t& operator+=(const state_t& a){return *this;}
+        state_t& operator+=(const state_t& a){done|=a.done;return *this;}
+
+        bool done=false;
     };
 
     struct mstate_t{
@@ -49,7 +52,7 @@ struct fake_model{
         friend void to_json(json& i, const termination_t& m){}
         friend void from_json(const json& j, termination_t& m){}
 
-        bool operator()(const state_t& s) const{return (rand()%100==1);}
+        bool operator()(const state_t& s) const{return s.done;}
     };
 
     friend void to_json(json& i, const fake_model& m){}
@@ -59,7 +62,12 @@ struct fake_model{
     inline const static bool recoverable=true;
 
     template<typename T>
-    delta_state_t operator()(const state_t& a, mstate_t& b, const T& env) const {usleep(5000);return delta_state_t();}
+    delta_state_t operator()(const state_t& a, mstate_t& b, const T& env) const {
+        usleep(5000);
+        delta_state_t d;
+        d.done=(env.rng().uniform()<0.01);
+        return d;
+    }
 };
 
 struct fake_callback{
@@ -88,6 +96,8 @@ int main(int argc, const char* argv[]){
     nlohmann::json config=nlohmann::json::parse(initial_data);
 
     if(argc>=2 && std::string(argv[1])=="continue")config["continue"]=true;
+    //The same configuration run as one of the workers of a distributed run.
+    if(argc>=2 && std::string(argv[1])=="worker")config["distributed"]["role"]="worker";
 
     try{
         simulator_t<fake_model,basic_callback,fake_tweaks> sim(config);
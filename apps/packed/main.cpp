@@ -0,0 +1,69 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief List, print or unpack the files of a packed workspace, as they would be in the directory layout.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <filesystem>
+
+#include "packed-workspace.h"
+
+static int usage(const char* name){
+    std::cerr<<"Usage: "<<name<<" <workspace>                   list the files and their sizes\n"
+             <<"       "<<name<<" <workspace> <file>            print the content of a file\n"
+             <<"       "<<name<<" <workspace> --unpack <dir>    write all the files in the directory layout\n";
+    return 1;
+}
+
+int main(int argc, const char* argv[]){
+    if(argc<2 || argc>4)return usage(argv[0]);
+
+    const std::string workspace=argv[1];
+    if(!std::filesystem::is_directory(workspace+"/segments")){
+        std::cerr<<"There is no packed workspace in ["<<workspace<<"]\n";
+        return 1;
+    }
+
+    try{
+        packed_workspace ws(workspace);
+        if(argc==2){
+            for(auto& f:ws.list())std::cout<<ws.size(f)<<"\t"<<f<<"\n";
+        }
+        else if(argc==3){
+            if(!ws.exists(argv[2])){
+                std::cerr<<"The file ["<<argv[2]<<"] is not in the workspace.\n";
+                return 1;
+            }
+            std::string content=ws.read(argv[2]);
+            std::cout.write(content.data(),content.size());
+        }
+        else if(std::string(argv[2])=="--unpack"){
+            const std::filesystem::path target=argv[3];
+            for(auto& f:ws.list()){
+                const std::filesystem::path path=target/f;
+                std::filesystem::create_directories(path.parent_path());
+                std::ofstream out(path,std::ios_base::binary|std::ios_base::trunc);
+                std::string content=ws.read(f);
+                out.write(content.data(),content.size());
+                if(!out){
+                    std::cerr<<"Unable to write ["<<path.string()<<"]\n";
+                    return 1;
+                }
+            }
+        }
+        else return usage(argv[0]);
+    }
+    catch(std::exception& e){
+        std::cerr<<"Unable to read the packed workspace ["<<workspace<<"]: "<<e.what()<<"\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Print the live progress of a run from the status page of its workspace.
+ * @version 0.1
+ * @date 2020-07-20
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+
+#include "status-page.h"
+
+static void print(const status_page& page){
+    const status_header_t& h=page.header();
+    const uint64_t finished=h.finished_ns.load(std::memory_order_relaxed);
+    const uint64_t now=finished?finished:status_page::now_ns();
+    const uint64_t completed=h.completed.load(std::memory_order_relaxed);
+    const uint64_t failed=h.failed.load(std::memory_order_relaxed);
+    const uint64_t queued=h.queued.load(std::memory_order_relaxed);
+    const uint64_t total=h.total.load(std::memory_order_relaxed);
+
+    std::cout<<"Run ["<<h.pid.load(std::memory_order_relaxed)<<"]"<<(finished?" finished":"")
+             <<"\telapsed "<<std::fixed<<std::setprecision(1)<<(now-h.started_ns.load(std::memory_order_relaxed))*1e-9<<"s"
+             <<"\ttotal ["<<total<<"]\tqueued ["<<queued<<"]\tcompleted ["<<completed<<"]\tfailed ["<<failed<<"]";
+    const uint64_t progress=h.updated_ns.load(std::memory_order_relaxed);
+    if(!finished)std::cout<<"\tlast progress "<<std::setprecision(1)<<(now>progress?now-progress:0)*1e-9<<"s ago";
+    std::cout<<"\n";
+
+    for(uint i=0;i<h.workers;i++){
+        const status_worker_t& w=page.worker(i);
+        const uint64_t instance=w.instance.load(std::memory_order_relaxed);
+        std::cout<<"  worker ["<<i<<"]\t";
+        if(instance==status_page::idle)std::cout<<"idle\t\t";
+        else{
+            const uint64_t b=w.batch.load(std::memory_order_relaxed);
+            std::cout<<(b<h.batches?page.batch(b).name:"?")<<"/"<<instance<<"\t";
+        }
+        const uint64_t updated=w.updated_ns.load(std::memory_order_relaxed);
+        std::cout<<"steps ["<<w.steps.load(std::memory_order_relaxed)<<"]\t"
+                 <<std::setprecision(1)<<w.rate.load(std::memory_order_relaxed)<<" steps/s\t"
+                 <<"completed ["<<w.completed.load(std::memory_order_relaxed)<<"]\tfailed ["<<w.failed.load(std::memory_order_relaxed)<<"]";
+        //The worker may have written it after the clock was read.
+        if(updated!=0)std::cout<<"\tlast checkpoint "<<std::setprecision(1)<<(now>updated?now-updated:0)*1e-9<<"s ago";
+        std::cout<<"\n";
+    }
+}
+
+int main(int argc, const char* argv[]){
+    if(argc<2){
+        std::cerr<<"Usage: "<<argv[0]<<" <workspace or status page> [refresh in ms]\n";
+        return 1;
+    }
+
+    std::string file=argv[1];
+    if(std::filesystem::is_directory(file))file+="/status.page";
+    const uint refresh=(argc>=3)?std::atoi(argv[2]):0;
+
+    try{
+        status_page page=status_page::open(file);
+        for(;;){
+            print(page);
+            if(refresh==0 || page.header().finished_ns.load(std::memory_order_relaxed)!=0)break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(refresh));
+            std::cout<<"\n";
+        }
+    }
+    catch(std::exception& e){
+        std::cerr<<"Unable to read the status page ["<<file<<"]: "<<e.what()<<"\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Compare the pooled workers_queue with the old thread-per-task queue on many short tasks.
+ * @version 0.1
+ * @date 2020-06-20
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <functional>
+#include <queue>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+
+#include "workers-queue.h"
+
+/**
+ * @brief The queue as it was before the pool, one thread for each task.
+ * Unlike the original, its threads are joined once reaped instead of being detached, as they could still be notifying the condition variable when the queue is destroyed.
+ */
+template <typename T>
+struct spawning_queue{
+    private:
+        struct thread_t{
+            thread_t(uint _id):id(_id){}
+
+            uint                            id;
+            int                             ret_val=0;
+            bool                            exception=false;
+            std::thread                     thread;
+            std::function<int()>            exec;
+        };
+
+        uint                        max_queue;
+        uint                        active_n=0;
+        uint                        next_id=0;
+        std::queue<uint>            remove_next;
+        std::map<uint,thread_t*>    threads;
+
+        std::condition_variable     cv;
+        std::mutex                  m;
+
+    public:
+        spawning_queue(uint l=1):max_queue(l){}
+        ~spawning_queue(){
+            for(auto [i,j]:threads){
+                if(j->thread.joinable())j->thread.join();
+                delete j;
+            }
+        }
+
+        int operator()(const T& cc){
+            uint bad_counter=0;
+            for(auto ii=cc.begin();ii!=cc.end() or active_n!=0;){
+                std::unique_lock<std::mutex> lock(m);
+                for(;active_n<max_queue && ii!=cc.end();++ii){
+                    auto& th=*(threads[next_id]=new thread_t(next_id));
+                    next_id++;
+                    th.exec=*ii;
+                    active_n++;
+                    th.thread=std::thread([&](thread_t* myself){
+                        try{myself->ret_val=myself->exec();}
+                        catch(...){myself->exception=true;}
+                        {
+                            std::unique_lock<std::mutex> lock(m);
+                            remove_next.push(myself->id);
+                            lock.unlock();
+                            cv.notify_all();
+                        }
+                    },&th);
+                }
+
+                cv.wait(lock, [&](){return remove_next.size()!=0;});
+                for(;remove_next.size()!=0;remove_next.pop(),active_n--){
+                    thread_t& th=*threads[remove_next.front()];
+                    //It has nothing left to do but to release the lock, which is held here.
+                    lock.unlock();
+                    th.thread.join();
+                    lock.lock();
+                    if(th.exception or th.ret_val!=0)bad_counter++;
+                }
+                lock.unlock();
+                cv.notify_all();
+            }
+            return bad_counter;
+        }
+};
+
+/**
+ * @brief A generator of identical tasks spinning for a fixed time.
+ */
+struct busy_tasks{
+    uint                        n;
+    std::chrono::microseconds   length;
+
+    struct const_iterator{
+        const busy_tasks*   p;
+        uint                i;
+
+        std::function<int()> operator*() const{
+            auto l=p->length;
+            return [l]()->int{
+                auto end=std::chrono::steady_clock::now()+l;
+                while(std::chrono::steady_clock::now()<end);
+                return 0;
+            };
+        }
+        const_iterator& operator++(){i++;return *this;}
+        friend bool operator!=(const const_iterator& a, const const_iterator& b){return a.i!=b.i;}
+    };
+
+    const_iterator begin() const{return {this,0};}
+    const_iterator end() const{return {this,n};}
+};
+
+template<typename F>
+static double measure(F&& f){
+    auto start=std::chrono::steady_clock::now();
+    f();
+    return std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+}
+
+int main(int argc, const char* argv[]){
+    uint n=(argc>=2)?std::atoi(argv[1]):20000;
+    uint parallel=(argc>=3)?std::atoi(argv[2]):std::thread::hardware_concurrency();
+    busy_tasks tasks{n,std::chrono::microseconds(1000)};
+
+    std::cout<<"Running ["<<n<<"] tasks of 1ms on ["<<parallel<<"] workers.\n";
+    std::cout<<"Ideal time: "<<(double)n/parallel<<" ms\n";
+
+    double t_spawn=measure([&](){spawning_queue<busy_tasks> q(parallel);q(tasks);});
+    std::cout<<"Thread per task: "<<t_spawn<<" ms\t("<<n/t_spawn*1000<<" tasks/s)\n";
+
+    double t_pool=measure([&](){workers_queue<busy_tasks> q(parallel);q(tasks,false,false);});
+    std::cout<<"Workers pool:    "<<t_pool<<" ms\t("<<n/t_pool*1000<<" tasks/s)\n";
+
+    return 0;
+}
@@ -0,0 +1,183 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Count the allocations and the time of the checkpoints of the simulator, for states serialized through a json document and through the streaming writer, and with delta checkpoints.
+ * @version 0.1
+ * @date 2020-07-10
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <filesystem>
+#include <array>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+
+#include <unistd.h>
+
+#include "simulator_t.h"
+
+static std::atomic<uint64_t> allocations=0;
+
+//Out of line, or the compiler sees malloc and free matched with new and delete.
+[[gnu::noinline]] void* operator new(size_t n){
+    allocations.fetch_add(1,std::memory_order_relaxed);
+    if(void* p=std::malloc(n==0?1:n))return p;
+    throw std::bad_alloc();
+}
+[[gnu::noinline]] void operator delete(void* p) noexcept{std::free(p);}
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept{std::free(p);}
+
+using nlohmann::json;
+
+/**
+ * @brief A model whose state is of moderate size, changing one of its cells at each step.
+ * @tparam STREAM does its state provide serialize, or only to_json?
+ */
+template<bool STREAM>
+struct bench_model{
+    struct state_t{
+        uint64_t                generation=0;
+        std::array<double,256>  cells{};
+
+        friend void to_json(json& j, const state_t& s){
+            j["generation"]=s.generation;
+            j["cells"]=s.cells;
+        }
+        friend void from_json(const json& j, state_t& s){
+            s.generation=j.value("generation",(uint64_t)0);
+            if(j.contains("cells"))s.cells=j["cells"].template get<std::array<double,256>>();
+        }
+
+        friend void serialize(json_writer& w, const state_t& s) requires STREAM{
+            w.begin_object().key("generation").value(s.generation).key("cells").begin_array();
+            for(double c:s.cells)w.value(c);
+            w.end_array().end_object();
+        }
+
+        state_t operator-(const state_t& a) const{
+            state_t ret=*this;
+            for(size_t i=0;i<cells.size();i++)ret.cells[i]-=a.cells[i];
+            return ret;
+        }
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=0;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)0);}
+
+        bool operator()(const state_t& s) const{return s.generation>=limit;}
+    };
+
+    friend void to_json(json&, const bench_model&){}
+    friend void from_json(const json&, bench_model&){}
+
+    inline const static bool differential=false;
+    inline const static bool recoverable=false;
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        state_t ret=s;
+        ret.cells[ret.generation%ret.cells.size()]=env.rng().uniform();
+        ret.generation++;
+        return ret;
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+struct measure_t{
+    uint64_t    allocations=0;
+    double      ms=0;
+};
+
+/**
+ * @brief Run one instance for a number of steps, with a sync every `sync` steps and a backup every `backup` syncs.
+ * @param delta are the checkpoints delta encoded, parsing and diffing each sync against its snapshot?
+ */
+template<typename M>
+static measure_t run(const std::string& workspace, uint64_t steps, uint sync, uint backup, bool delta){
+    json config={
+        {"workspace",workspace},
+        {"model",json::object()},
+        {"parallel",1u},
+        {"status-page",false},
+        {"tasks",{{"a",{{"end-condition",{{"limit",steps}}},{"instances",1u},{"sync",sync},{"backup",backup},{"save-trace",false}}}}}
+    };
+    if(delta)config["tasks"]["a"]["checkpoint"]={{"encoding","delta"}};
+    std::ostringstream out, err;
+    measure_t ret;
+    const uint64_t before=allocations.load();
+    auto start=std::chrono::steady_clock::now();
+    {
+        simulator_t<M,null_callback,null_tweaks> sim(config,out,err);
+        sim();
+    }
+    ret.ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    ret.allocations=allocations.load()-before;
+    std::filesystem::remove_all(workspace);
+    return ret;
+}
+
+/**
+ * @brief The cost of n checkpoints, as the difference between a run syncing at every step and one syncing only at its end.
+ */
+template<typename M>
+static measure_t checkpoints(const std::string& root, uint64_t n, uint backup, bool delta){
+    measure_t every=run<M>(root+"/every",n,1,backup,delta);
+    measure_t last=run<M>(root+"/last",n,n+1,backup,delta);
+    return {every.allocations-last.allocations,every.ms-last.ms};
+}
+
+/**
+ * @brief The cost of each checkpoint once warm, as the difference between n and 2n checkpoints: the buffers filled by the first ones are left out.
+ * The time is the throughput of the whole writer stage, the simulation thread only waits for it when its queue is full.
+ */
+template<typename M>
+static void checkpoint(const char* name, const std::string& root, uint64_t n, uint backup, bool delta=false){
+    measure_t first=checkpoints<M>(root,n,backup,delta);
+    measure_t both=checkpoints<M>(root,2*n,backup,delta);
+    std::cout<<name<<(double)((int64_t)both.allocations-(int64_t)first.allocations)/n<<" allocations/checkpoint\t"<<(both.ms-first.ms)/n*1000<<" us/checkpoint\n";
+}
+
+int main(int argc, const char* argv[]){
+    uint64_t n=(argc>=2)?std::atoi(argv[1]):2000;
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-benchmark-3-"+std::to_string(getpid()))).string();
+
+    std::cout<<"Running ["<<n<<"] checkpoints of a state with 256 doubles, through simulator_t.\n";
+    std::cout<<"Sync only, the backup is taken at the end:\n";
+    checkpoint<bench_model<false>>("  Json document:    ",root,n,2*n+1);
+    checkpoint<bench_model<true>>("  Streaming writer: ",root,n,2*n+1);
+    std::cout<<"Sync and backup:\n";
+    checkpoint<bench_model<false>>("  Json document:    ",root,n,1);
+    checkpoint<bench_model<true>>("  Streaming writer: ",root,n,1);
+    //Each sync parses the whole state and diffs it against the snapshot, so it costs more CPU than the full encoding to write less.
+    std::cout<<"Sync and backup, delta encoded:\n";
+    checkpoint<bench_model<true>>("  Streaming writer: ",root,n,1,true);
+    std::filesystem::remove_all(root);
+    return 0;
+}
@@ -0,0 +1,108 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Time a fixed amount of work leased by a coordinator to an increasing number of local worker processes.
+ * @version 0.1
+ * @date 2020-07-16
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <vector>
+#include <cstdlib>
+#include <algorithm>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "lease-coordinator.h"
+
+/**
+ * @brief A generator of jobs with no simulation behind them, one instance each.
+ */
+struct synthetic_jobs{
+    uint    jobs;
+
+    struct const_iterator{
+        uint i;
+
+        inline process_job_t key() const{process_job_t j;j.first=i;return j;}
+        inline const_iterator& operator++(){i++;return *this;}
+        friend inline bool operator!=(const const_iterator& a, const const_iterator& b){return a.i!=b.i;}
+    };
+
+    const_iterator begin() const{return {0};}
+    const_iterator end() const{return {jobs};}
+};
+
+/**
+ * @brief A fixed amount of work, as a step of a simulation would do.
+ * It is not bounded by time, or workers sharing a core would look faster than they are.
+ */
+static int busy(uint64_t rounds){
+    volatile uint64_t acc=0;
+    for(uint64_t r=0;r<rounds;r++)for(uint i=0;i<1000;i++)acc=acc+i;
+    return 0;
+}
+
+/**
+ * @brief How many rounds of busy take about this long on this machine.
+ */
+static uint64_t calibrate(uint us){
+    const uint64_t probe=1000;
+    auto start=std::chrono::steady_clock::now();
+    busy(probe);
+    double per_round=std::chrono::duration<double,std::micro>(std::chrono::steady_clock::now()-start).count()/probe;
+    return std::max<uint64_t>(1,us/per_round);
+}
+
+static double run(uint workers, uint jobs, uint64_t rounds, uint chunk){
+    const std::string address="unix:/tmp/ssagi-benchmark-4-"+std::to_string(getpid())+".sock";
+    synthetic_jobs gen{jobs};
+    lease_coordinator<synthetic_jobs> coordinator(address,chunk,30000,0);
+
+    std::cout.flush();
+    std::vector<pid_t> pids;
+    for(uint w=0;w<workers;w++){
+        pid_t pid=fork();
+        if(pid<0)throw StringException("ForkException");
+        if(pid==0){
+            int code=0;
+            try{
+                lease_client client(address,[rounds](const process_job_t&){return busy(rounds);});
+                workers_queue<lease_client> queue(1);
+                for(;!client.finished();)queue(client,false,false);
+            }
+            catch(...){code=1;}
+            _exit(code);
+        }
+        pids.push_back(pid);
+    }
+
+    auto start=std::chrono::steady_clock::now();
+    int failed=coordinator(gen,nullptr,false);
+    double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+    for(pid_t pid:pids)waitpid(pid,nullptr,0);
+    if(failed!=0)std::cerr<<"["<<failed<<"] jobs failed.\n";
+    return ms;
+}
+
+int main(int argc, const char* argv[]){
+    uint jobs=(argc>=2)?std::atoi(argv[1]):256;
+    uint us=(argc>=3)?std::atoi(argv[2]):5000;
+    uint chunk=(argc>=4)?std::atoi(argv[3]):4;
+
+    std::cout<<"Running ["<<jobs<<"] jobs of ["<<us<<"] us each, leased in chunks of ["<<chunk<<"], on "<<sysconf(_SC_NPROCESSORS_ONLN)<<" cores.\n";
+    const uint64_t rounds=calibrate(us);
+    double base=0;
+    for(uint workers:{1u,2u,4u}){
+        double ms=run(workers,jobs,rounds,chunk);
+        if(workers==1)base=ms;
+        std::cout<<workers<<" workers:\t"<<ms<<" ms\tspeedup "<<base/ms<<"\n";
+    }
+    return 0;
+}
@@ -14,6 +14,9 @@
 #include <nlohmann/json.hpp>
 #include <cpr/cpr.h>
 #include <cstdlib>
+#include <optional>
+#include <functional>
+#include <chrono>
 
 #include "string-exception.h"
 
@@ -27,7 +30,7 @@ struct basic_callback{
         {
             auto it=config.find("url");
             if(it!=config.end() && it->is_string()){
-                m.url.value()=*it;
+                m.url=it->get<std::string>();
             }
             else if(it!=config.end())_type_mismatch("url","string");
             else;
@@ -35,11 +38,19 @@ struct basic_callback{
         {
             auto it=config.find("script");
             if(it!=config.end() && it->is_string()){
-                m.script.value()=*it;
+                m.script=it->get<std::string>();
             }
             else if(it!=config.end())_type_mismatch("script","string");
             else;
         }
+        {
+            auto it=config.find("min-interval-ms");
+            if(it!=config.end() && it->is_number_unsigned()){
+                m.interval=std::chrono::milliseconds(it->get<uint>());
+            }
+            else if(it!=config.end())_type_mismatch("min-interval-ms","unsigned integer");
+            else;
+        }
     }
 
     template<typename T>
@@ -53,9 +64,25 @@ struct basic_callback{
         }
     }
 
+    /**
+     * @brief The same notification as the call operator, as a job which can be run later on any thread.
+     */
+    std::function<void()> deferred() const{
+        return [url=url,script=script](){
+            if(url.has_value())cpr::Get(cpr::Url{url.value()});
+            if(script.has_value())std::system(script.value().c_str());
+        };
+    }
+
+    /**
+     * @brief The minimum time between two notifications for the same instance, the ones in between are coalesced.
+     */
+    inline std::chrono::milliseconds min_interval() const{return interval;}
+
     private:
         std::optional<std::string> url;
         std::optional<std::string> script;
+        std::chrono::milliseconds  interval{0};
 
         static void _type_mismatch(const std::string& field, const std::string& expected){
             throw StringException("TypeMismatchException for ["+field+"] expected ["+expected+"]");
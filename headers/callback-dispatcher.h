@@ -0,0 +1,209 @@
+#pragma once
+
+/**
+ * @file callback-dispatcher.h
+ * @author karurochari
+ * @brief Asynchronous dispatcher for the callbacks, so that the simulation threads never wait for them.
+ * @version 0.1
+ * @date 2020-07-08
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <functional>
+#include <unordered_map>
+#include <queue>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#include "phase-metrics.h"
+
+/**
+ * @brief A small pool of threads running the callbacks posted by the simulation threads.
+ * Each notification has a key (usually one for each callback and instance), and at most one notification for each key is pending at any time:
+ * posting again while one is pending is merged into it, so the job is only built for the notifications which are run (coalescing).
+ * With a minimum interval, a notification is also delayed until that much time has passed since the last one with the same key was dispatched.
+ * Posting never blocks: once the queue is full, new notifications are dropped.
+ * Notifications which must not be lost, like the completion of an instance, are delivered instead: they are run once each, in order and without delay,
+ * and delivering waits for room once as many of them are pending as the capacity.
+ */
+struct callback_dispatcher{
+    typedef std::chrono::steady_clock   clock_t;
+    typedef std::function<void()>       job_t;
+
+    /**
+     * @param threads how many callbacks can run concurrently.
+     * @param _capacity the maximum number of pending notifications.
+     */
+    callback_dispatcher(uint threads=1, uint _capacity=1024):capacity(_capacity==0?1:_capacity){
+        if(threads==0)threads=1;
+        for(uint i=0;i<threads;i++)pool.emplace_back(&callback_dispatcher::_serve,this);
+    }
+
+    callback_dispatcher(const callback_dispatcher&)=delete;
+
+    ~callback_dispatcher(){
+        {
+            std::lock_guard<std::mutex> lock(m);
+            stop=true;
+        }
+        ready.notify_all();
+        for(auto& t:pool)t.join();
+    }
+
+    /**
+     * @brief Queue a notification.
+     * @param key notifications sharing the key are coalesced.
+     * @param min_interval the minimum time between two notifications with this key being dispatched.
+     * @param make builds the job to be run, only called if the notification is neither coalesced nor dropped.
+     */
+    template<typename F>
+    void post(uint64_t key, std::chrono::milliseconds min_interval, F&& make){
+        std::unique_lock<std::mutex> lock(m);
+        auto it=slots.find(key);
+        if(it!=slots.end() && it->second.pending){
+            _coalesced++;
+            return;
+        }
+        if(heap.size()>=capacity){
+            _dropped++;
+            return;
+        }
+        if(it==slots.end())it=slots.try_emplace(key).first;
+        slot_t& s=it->second;
+        const auto now=clock_t::now();
+        const auto due=(s.dispatched && s.last+min_interval>now)?s.last+min_interval:now;
+        s.job=make();
+        s.pending=true;
+        s.interval=min_interval;
+        heap.push({due,key});
+        lock.unlock();
+        ready.notify_one();
+    }
+
+    /**
+     * @brief Queue a notification which is never coalesced nor dropped, waiting for room if needed.
+     * @param job what should be run.
+     */
+    void deliver(job_t job){
+        std::unique_lock<std::mutex> lock(m);
+        if(reliable.size()>=capacity){
+            _waited++;
+            room.wait(lock,[&](){return reliable.size()<capacity;});
+        }
+        reliable.push_back(std::move(job));
+        lock.unlock();
+        ready.notify_one();
+    }
+
+    /**
+     * @brief Wait until all the notifications posted so far have been run, delayed ones included.
+     */
+    void drain(){
+        std::unique_lock<std::mutex> lock(m);
+        idle.wait(lock,[&](){return heap.empty() && reliable.empty() && running==0;});
+    }
+
+    inline uint64_t dispatched() const{return _dispatched.load(std::memory_order_relaxed);}
+    inline uint64_t coalesced() const{return _coalesced.load(std::memory_order_relaxed);}
+    inline uint64_t dropped() const{return _dropped.load(std::memory_order_relaxed);}
+    inline uint64_t failed() const{return _failed.load(std::memory_order_relaxed);}
+    inline uint64_t waited() const{return _waited.load(std::memory_order_relaxed);}     ///< How many deliveries had to wait for room.
+
+    private:
+        struct slot_t{
+            job_t                       job;
+            clock_t::time_point         last;
+            std::chrono::milliseconds   interval{0};
+            bool                        pending=false;
+            bool                        dispatched=false;
+        };
+
+        typedef std::pair<clock_t::time_point,uint64_t> entry_t;    ///< When it is due, and its key.
+
+        uint                                                                    capacity;
+        std::mutex                                                              m;
+        std::condition_variable                                                 ready;
+        std::condition_variable                                                 idle;
+        std::condition_variable                                                 room;
+        std::unordered_map<uint64_t,slot_t>                                     slots;
+        std::priority_queue<entry_t,std::vector<entry_t>,std::greater<entry_t>> heap;
+        std::deque<job_t>                                                       reliable;   ///< The delivered notifications, in order.
+        uint                                                                    running=0;
+        bool                                                                    stop=false;
+        std::vector<std::thread>                                                pool;
+
+        std::atomic<uint64_t>                                                   _dispatched=0;
+        std::atomic<uint64_t>                                                   _coalesced=0;
+        std::atomic<uint64_t>                                                   _dropped=0;
+        std::atomic<uint64_t>                                                   _failed=0;
+        std::atomic<uint64_t>                                                   _waited=0;
+
+        void _serve(){
+            std::unique_lock<std::mutex> lock(m);
+            for(;;){
+                job_t job;
+                //Delivered notifications are never delayed, so they go first.
+                if(!reliable.empty()){
+                    job=std::move(reliable.front());
+                    reliable.pop_front();
+                    room.notify_one();
+                }
+                else{
+                    if(heap.empty()){
+                        if(stop)return;
+                        ready.wait(lock);
+                        continue;
+                    }
+                    //Pending notifications are still run when stopping, without waiting for their interval.
+                    const auto due=heap.top().first;
+                    if(!stop && due>clock_t::now()){
+                        ready.wait_until(lock,due);
+                        continue;
+                    }
+
+                    const uint64_t key=heap.top().second;
+                    heap.pop();
+                    slot_t& s=slots[key];
+                    job=std::move(s.job);
+                    s.pending=false;
+                    s.dispatched=true;
+                    s.last=clock_t::now();
+                    //Slots without an interval have nothing to remember.
+                    if(s.interval.count()==0)slots.erase(key);
+                    else if(slots.size()>2*capacity)_prune(s.last);
+                }
+                running++;
+                lock.unlock();
+
+                try{
+                    phase_scope timed(phase_t::callback);
+                    job();
+                    _dispatched++;
+                }
+                catch(...){
+                    _failed++;
+                }
+
+                lock.lock();
+                running--;
+                if(heap.empty() && reliable.empty() && running==0)idle.notify_all();
+            }
+        }
+
+        /**
+         * @brief Forget the slots whose interval has already expired, so that their number does not grow with the instances.
+         */
+        void _prune(clock_t::time_point now){
+            for(auto it=slots.begin();it!=slots.end();){
+                if(!it->second.pending && it->second.last+it->second.interval<=now)it=slots.erase(it);
+                else it++;
+            }
+        }
+};
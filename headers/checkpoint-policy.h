@@ -0,0 +1,152 @@
+#pragma once
+
+/**
+ * @file checkpoint-policy.h
+ * @author karurochari
+ * @brief When the instances are checkpointed, by step count, by wall-clock time or by measured overhead.
+ * @version 0.1
+ * @date 2020-07-12
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+/**
+ * @brief How the interval between two checkpoints is chosen.
+ * - `steps` syncs every *sync*+1 steps, as the counters always did.
+ * - `time` syncs about every *interval-ms* of wall-clock time.
+ * - `overhead` syncs as often as possible while the time spent checkpointing stays below a fraction of the time of the task, and at least every *interval-ms*.
+ */
+enum class checkpoint_policy_t{steps, time, overhead};
+
+inline bool checkpoint_policy_from_string(const std::string& s, checkpoint_policy_t& p){
+    if(s=="steps")p=checkpoint_policy_t::steps;
+    else if(s=="time")p=checkpoint_policy_t::time;
+    else if(s=="overhead")p=checkpoint_policy_t::overhead;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Plan the step of the next checkpoint of an instance.
+ * With time based policies the cost of a step and of a checkpoint are measured at each checkpoint, and the interval is converted into a number of steps.
+ * The number of steps can at most double from one checkpoint to the next, so that a wrong estimate does not delay a checkpoint for long.
+ * Steps which become slower than estimated are caught by probe() and overdue(): the clock is also read about every microsecond of estimated work,
+ * and the checkpoint is taken early once *interval-ms* has passed since the last one.
+ */
+struct checkpoint_planner{
+    typedef std::chrono::steady_clock clock_t;
+
+    /**
+     * @param _policy the policy.
+     * @param _sync the steps skipped between two syncs, for the `steps` policy.
+     * @param _backup the syncs skipped between two backups.
+     * @param interval_ms the interval for the `time` policy, or the longest one for the `overhead` policy.
+     * @param _overhead the fraction of time which can be spent checkpointing, for the `overhead` policy.
+     */
+    checkpoint_planner(checkpoint_policy_t _policy=checkpoint_policy_t::steps, uint _sync=0, uint _backup=0, uint interval_ms=1000, double _overhead=0.02):
+        policy(_policy),sync(_sync),backup(_backup),interval(std::chrono::duration<double,std::nano>(std::chrono::milliseconds(interval_ms)).count()),overhead(_overhead){}
+
+    /**
+     * @brief The step of the first checkpoint, for an instance starting at this step.
+     */
+    uint64_t first(uint64_t steps){
+        if(policy==checkpoint_policy_t::steps){
+            const uint64_t period=sync+1;
+            return ((steps+period-1)/period)*period;
+        }
+        return steps;
+    }
+
+    /**
+     * @brief Should this checkpoint also update the backup copies?
+     */
+    bool backup_due(uint64_t steps){
+        if(steps==0)return false;
+        if(policy==checkpoint_policy_t::steps)return (steps%(((uint64_t)sync+1)*(backup+1)))==0;
+        return ((++syncs)%(backup+1))==0;
+    }
+
+    /**
+     * @brief The moment a checkpoint starts, to measure its cost.
+     */
+    inline void begin(){
+        if(policy!=checkpoint_policy_t::steps)started=clock_t::now();
+    }
+
+    /**
+     * @brief Record the end of a checkpoint taken at this step.
+     * @return the step of the next one.
+     */
+    uint64_t end(uint64_t steps){
+        if(policy==checkpoint_policy_t::steps)return (steps/(sync+1)+1)*(sync+1);
+
+        const auto now=clock_t::now();
+        const double cost=std::chrono::duration<double,std::nano>(now-started).count();
+        sync_ns=(sync_ns==0)?cost:(1-alpha)*sync_ns+alpha*cost;
+        if(measured && steps>last_steps){
+            const double step=std::chrono::duration<double,std::nano>(started-last_end).count()/(steps-last_steps);
+            step_ns=(step_ns==0)?step:(1-alpha)*step_ns+alpha*step;
+        }
+        measured=true;
+        last_end=now;
+        last_steps=steps;
+
+        double target=interval;
+        if(policy==checkpoint_policy_t::overhead)target=std::min(interval,sync_ns/overhead);
+
+        uint64_t k=1;
+        if(step_ns>0)k=std::max<uint64_t>(1,(uint64_t)(target/step_ns));
+        k=std::min(k,2*last_k);
+        last_k=k;
+        return steps+k;
+    }
+
+    /**
+     * @brief The step at which the clock should be read next, for an instance at this step. Never with the `steps` policy.
+     */
+    uint64_t probe(uint64_t steps) const{
+        if(policy==checkpoint_policy_t::steps)return std::numeric_limits<uint64_t>::max();
+        if(step_ns<=0)return steps+1;
+        return steps+std::max<uint64_t>(1,(uint64_t)(probe_ns/step_ns));
+    }
+
+    /**
+     * @brief Has the longest interval between two checkpoints already passed since the last one? It reads the clock.
+     */
+    bool overdue() const{
+        if(policy==checkpoint_policy_t::steps || !measured)return false;
+        return std::chrono::duration<double,std::nano>(clock_t::now()-last_end).count()>=interval;
+    }
+
+    /**
+     * @brief The estimated costs, in nanoseconds.
+     */
+    inline double step_cost() const{return step_ns;}
+    inline double checkpoint_cost() const{return sync_ns;}
+
+    private:
+        static constexpr double     alpha=0.25;     ///< The weight of the last measure in the moving averages.
+        static constexpr double     probe_ns=1000;  ///< The estimated work between two reads of the clock, in nanoseconds.
+
+        checkpoint_policy_t         policy;
+        uint                        sync;
+        uint                        backup;
+        double                      interval;       ///< In nanoseconds.
+        double                      overhead;
+
+        uint64_t                    syncs=0;
+        clock_t::time_point         started;
+        clock_t::time_point         last_end;
+        uint64_t                    last_steps=0;
+        uint64_t                    last_k=1;
+        bool                        measured=false;
+        double                      step_ns=0;
+        double                      sync_ns=0;
+};
@@ -0,0 +1,219 @@
+#pragma once
+
+/**
+ * @file coroutine-queue.h
+ * @author karurochari
+ * @brief Instances as coroutines, suspended at their checkpoints and multiplexed over a fixed pool of workers in time slices.
+ * @version 0.1
+ * @date 2020-07-26
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <coroutine>
+#include <exception>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include "workers-queue.h"
+#include "phase-metrics.h"
+
+/**
+ * @brief A task which can be run one slice at a time. It starts suspended, and every `co_await std::suspend_always{}` in its body ends a slice.
+ * Its state lives in the coroutine frame, so a suspended task costs its frame and nothing else, no thread nor stack.
+ */
+struct task_slice{
+    struct promise_type{
+        int                 result=0;
+        std::exception_ptr  exception;
+
+        task_slice get_return_object(){return task_slice(std::coroutine_handle<promise_type>::from_promise(*this));}
+        std::suspend_always initial_suspend() noexcept{return {};}
+        std::suspend_always final_suspend() noexcept{return {};}
+        void return_value(int v){result=v;}
+        void unhandled_exception(){exception=std::current_exception();}
+    };
+
+    task_slice()=default;
+    task_slice(const task_slice&)=delete;
+    task_slice(task_slice&& o):handle(o.handle){o.handle=nullptr;}
+    task_slice& operator=(task_slice&& o){
+        if(handle)handle.destroy();
+        handle=o.handle;
+        o.handle=nullptr;
+        return *this;
+    }
+    ~task_slice(){if(handle)handle.destroy();}
+
+    /**
+     * @brief Run the next slice, rethrowing what escaped the task.
+     * @return true once the task is over.
+     */
+    bool resume(){
+        handle.resume();
+        if(handle.promise().exception)std::rethrow_exception(handle.promise().exception);
+        return handle.done();
+    }
+
+    inline int result() const{return handle.promise().result;}
+
+    private:
+        std::coroutine_handle<promise_type> handle=nullptr;
+
+        explicit task_slice(std::coroutine_handle<promise_type> h):handle(h){}
+};
+
+/**
+ * @brief A fixed pool of workers running the slices of many tasks in flight at once.
+ * The next slice is always taken from the task of highest priority, and among those from the one which ran the fewest slices, so that long tasks cannot starve short ones.
+ * Slices are counted in virtual time: a new task starts from the latest time of the tasks run so far, so that tasks already in flight are not starved by newcomers either.
+ * New tasks are taken from the generator only while fewer than a given number are in flight, as each of them keeps its frame alive until it is over.
+ * The whole run can be paused between two slices, keeping every task suspended in memory, and later resumed.
+ * @tparam T the generator type, whose iterators expose `slice()` returning a task_slice and `priority()` returning an integer, higher first.
+ */
+template <typename T>
+struct coroutine_queue{
+    /**
+     * @param l the number of workers.
+     * @param f the maximum number of tasks in flight, 4 for each worker if 0.
+     */
+    coroutine_queue(uint l=1, uint f=0):max_queue(l==0?1:l),in_flight(f==0?4*max_queue:std::max(f,max_queue)){}
+
+    coroutine_queue(const coroutine_queue&)=delete;
+
+    /**
+     * @brief When set the workers stop taking slices, once the current ones are over. It is lock-free, so it can be toggled by a signal handler.
+     */
+    static inline std::atomic<bool> paused=false;
+
+    /**
+     * @brief Run all the tasks of the generator.
+     * @return the number of tasks failed.
+     */
+    int operator()(const T& cc, bool verbose=true, std::ostream& out=std::cout, std::ostream& err=std::cerr){
+        uint bad_counter=0;
+        auto ii=cc.begin();
+        const auto ee=cc.end();
+        ready.clear();
+        alive=0;
+
+        auto body=[&](uint self){
+            this_worker=self;
+            for(;;){
+                std::unique_ptr<entry_t> e;
+                {
+                    phase_scope idle(phase_t::idle);
+                    std::unique_lock<std::mutex> lock(m);
+                    for(;;){
+                        for(;alive<in_flight && ii!=ee;++ii){
+                            auto n=std::make_unique<entry_t>();
+                            n->id=next_id++;
+                            n->priority=ii.priority();
+                            n->vtime=floor;
+                            n->seq=next_seq++;
+                            n->slice=ii.slice();
+                            if(verbose)out<<"Started   ["<<n->id<<"]\n";
+                            _push(std::move(n));
+                            alive++;
+                        }
+                        if(!paused.load(std::memory_order_relaxed) && !ready.empty()){
+                            std::pop_heap(ready.begin(),ready.end(),_after);
+                            e=std::move(ready.back());
+                            ready.pop_back();
+                            floor=std::max(floor,e->vtime);
+                            break;
+                        }
+                        if(alive==0 && !(ii!=ee)){
+                            cv.notify_all();
+                            return;
+                        }
+                        //Slices being run will put their task back, and a pause is lifted without notice.
+                        cv.wait_for(lock,std::chrono::milliseconds(20));
+                    }
+                }
+
+                if(e->slices==0)e->start=std::chrono::steady_clock::now();
+                bool over=true;
+                bool exception=false;
+                try{
+                    phase_scope task(phase_t::task);
+                    over=e->slice.resume();
+                }
+                catch(...){
+                    exception=true;
+                }
+
+                std::lock_guard<std::mutex> lock(m);
+                if(!over){
+                    e->slices++;
+                    e->vtime++;
+                    e->seq=next_seq++;
+                    _push(std::move(e));
+                }
+                else{
+                    alive--;
+                    const int ret=exception?0:e->slice.result();
+                    if(verbose){
+                        if(exception)err<<"Exception in task ["<<e->id<<"]\n";
+                        else out<<"Completed ["<<e->id<<"]\tin "<<std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-e->start).count()<<". Returned ["<<ret<<"]\n";
+                    }
+                    if(exception || ret!=0)bad_counter++;
+                }
+                cv.notify_all();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(max_queue);
+        for(uint i=0;i<max_queue;i++)threads.emplace_back(body,i);
+        for(auto& t:threads)t.join();
+
+        if(verbose && bad_counter!=0){
+            out<<"Queue completed. ["<<bad_counter<<"] tasks failed.";
+        }
+        return bad_counter;
+    }
+
+    private:
+        struct entry_t{
+            uint                                        id=0;
+            int                                         priority=0;
+            uint64_t                                    slices=0;   ///< The slices it ran so far.
+            uint64_t                                    vtime=0;    ///< Its position in virtual time, the slices it ran plus the virtual time when it arrived.
+            uint64_t                                    seq=0;      ///< When it was last queued, to break ties in order.
+            std::chrono::steady_clock::time_point       start;
+            task_slice                                  slice;
+        };
+
+        uint                                    max_queue;
+        uint                                    in_flight;
+        uint                                    next_id=0;
+        uint64_t                                next_seq=0;
+        uint                                    alive=0;            ///< The tasks in flight, queued or running.
+        uint64_t                                floor=0;            ///< The latest virtual time of the tasks run, where new tasks start.
+        std::vector<std::unique_ptr<entry_t>>   ready;              ///< A heap of the tasks waiting for their next slice.
+        std::mutex                              m;
+        std::condition_variable                 cv;
+
+        /**
+         * @brief The order of the heap: is a to be run after b?
+         */
+        static bool _after(const std::unique_ptr<entry_t>& a, const std::unique_ptr<entry_t>& b){
+            if(a->priority!=b->priority)return a->priority<b->priority;
+            if(a->vtime!=b->vtime)return a->vtime>b->vtime;
+            return a->seq>b->seq;
+        }
+
+        void _push(std::unique_ptr<entry_t> e){
+            ready.push_back(std::move(e));
+            std::push_heap(ready.begin(),ready.end(),_after);
+        }
+};
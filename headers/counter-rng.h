@@ -0,0 +1,153 @@
+#pragma once
+
+/**
+ * @file counter-rng.h
+ * @author karurochari
+ * @brief Counter-based random number generator, to give each instance its own reproducible stream.
+ * @version 0.1
+ * @date 2020-06-28
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <cstdint>
+#include <cmath>
+#include <span>
+#include <array>
+#include <limits>
+
+#include <nlohmann/json.hpp>
+
+#include "json-writer.h"
+
+/**
+ * @brief Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+ * The output is a pure function of the key, the stream and the position, so the whole state is three integers and any position can be reached in constant time.
+ * It satisfies UniformRandomBitGenerator, so it can be used with the distributions of `<random>` as well.
+ */
+struct philox_rng{
+    typedef uint32_t result_type;
+
+    /**
+     * @param _key the seed, shared by all the streams of a batch.
+     * @param _stream the stream, one for each instance.
+     * @param _position the number of 32bit words already drawn from the stream.
+     */
+    philox_rng(uint64_t _key=0, uint64_t _stream=0, uint64_t _position=0):key(_key),stream(_stream),position(_position){}
+
+    static constexpr result_type min(){return 0;}
+    static constexpr result_type max(){return std::numeric_limits<result_type>::max();}
+
+    inline result_type operator()(){
+        const uint64_t block=position>>2;
+        if(block!=cached_block){
+            cached=_block(block);
+            cached_block=block;
+        }
+        return cached[(position++)&3];
+    }
+
+    /**
+     * @brief A uniform double in [0,1), with 53 random bits.
+     */
+    inline double uniform(){
+        uint64_t hi=(*this)();
+        uint64_t lo=(*this)();
+        return (double)(((hi<<32)|lo)>>11)*0x1.0p-53;
+    }
+
+    /**
+     * @brief Fill a buffer with random words, four for each block, without going through the cache.
+     */
+    void fill(std::span<uint32_t> out){
+        size_t i=0;
+        //Align to a block boundary first.
+        for(;i<out.size() && (position&3)!=0;i++)out[i]=(*this)();
+
+        const size_t blocks=(out.size()-i)/4;
+        const uint64_t first=position>>2;
+        for(size_t b=0;b<blocks;b++){
+            auto r=_block(first+b);
+            for(uint j=0;j<4;j++)out[i+4*b+j]=r[j];
+        }
+        i+=4*blocks;
+        position+=4*blocks;
+
+        for(;i<out.size();i++)out[i]=(*this)();
+    }
+
+    /**
+     * @brief Fill a buffer with uniform doubles in [0,1).
+     */
+    void fill_uniform(std::span<double> out){
+        constexpr size_t chunk=64;
+        uint32_t words[2*chunk];
+        for(size_t i=0;i<out.size();i+=chunk){
+            const size_t n=std::min(chunk,out.size()-i);
+            fill(std::span<uint32_t>(words,2*n));
+            for(size_t j=0;j<n;j++){
+                out[i+j]=(double)((((uint64_t)words[2*j]<<32)|words[2*j+1])>>11)*0x1.0p-53;
+            }
+        }
+    }
+
+    /**
+     * @brief Fill a buffer with standard normal doubles, by Box-Muller.
+     */
+    void fill_normal(std::span<double> out){
+        fill_uniform(out);
+        for(size_t i=0;i+1<out.size();i+=2){
+            const double r=std::sqrt(-2.0*std::log(1.0-out[i]));
+            const double t=2.0*M_PI*out[i+1];
+            out[i]=r*std::cos(t);
+            out[i+1]=r*std::sin(t);
+        }
+        if(out.size()%2==1){
+            const double u0=uniform(), u1=uniform();
+            out[out.size()-1]=std::sqrt(-2.0*std::log(1.0-u0))*std::cos(2.0*M_PI*u1);
+        }
+    }
+
+    inline uint64_t get_position() const{return position;}
+
+    friend void to_json(nlohmann::json& j, const philox_rng& r){
+        j=nlohmann::json{{"key",r.key},{"stream",r.stream},{"position",r.position}};
+    }
+
+    friend void serialize(json_writer& w, const philox_rng& r){
+        w.begin_object().key("key").value(r.key).key("stream").value(r.stream).key("position").value(r.position).end_object();
+    }
+
+    friend void from_json(const nlohmann::json& j, philox_rng& r){
+        r=philox_rng(j.at("key").get<uint64_t>(),j.at("stream").get<uint64_t>(),j.at("position").get<uint64_t>());
+    }
+
+    private:
+        uint64_t                    key;
+        uint64_t                    stream;
+        uint64_t                    position;
+        uint64_t                    cached_block=std::numeric_limits<uint64_t>::max();
+        std::array<uint32_t,4>      cached;
+
+        static inline void _mulhilo(uint32_t a, uint32_t b, uint32_t& hi, uint32_t& lo){
+            const uint64_t p=(uint64_t)a*b;
+            hi=p>>32;
+            lo=(uint32_t)p;
+        }
+
+        std::array<uint32_t,4> _block(uint64_t counter) const{
+            uint32_t c0=(uint32_t)counter, c1=(uint32_t)(counter>>32), c2=(uint32_t)stream, c3=(uint32_t)(stream>>32);
+            uint32_t k0=(uint32_t)key, k1=(uint32_t)(key>>32);
+            for(uint r=0;r<10;r++){
+                uint32_t hi0,lo0,hi1,lo1;
+                _mulhilo(0xD2511F53u,c0,hi0,lo0);
+                _mulhilo(0xCD9E8D57u,c2,hi1,lo1);
+                const uint32_t n0=hi1^c1^k0, n1=lo1, n2=hi0^c3^k1, n3=lo0;
+                c0=n0;c1=n1;c2=n2;c3=n3;
+                k0+=0x9E3779B9u;
+                k1+=0xBB67AE85u;
+            }
+            return {c0,c1,c2,c3};
+        }
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+/**
+ * @file delta-checkpoint.h
+ * @author karurochari
+ * @brief Checkpoints written as a full snapshot followed by JSON patches against it, optionally compressed.
+ * @version 0.1
+ * @date 2020-07-29
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+
+#include <nlohmann/json.hpp>
+
+#ifdef SSAGI_ZSTD
+#include <zstd.h>
+#endif
+
+#include "hashing.h"
+
+/**
+ * @brief The checkpoints of one file of a task, as a snapshot in the file itself and a log of records in `%file.delta`.
+ * Each record holds the JSON patch from the snapshot to the content at a later sync, so only the last one is needed to rebuild it, and the log is emptied with each new snapshot.
+ * Records are framed as
+ * ```
+ * uint32 size, uint32 raw size (0 if not compressed), uint64 FNV-1a of the payload, payload
+ * ```
+ * so that a record cut short by a crash is recognized and the previous one is used instead.
+ * Their payload also names the snapshot they patch, as the snapshot and its log are two files and need not be written together.
+ */
+struct delta_stream{
+    static constexpr size_t header_size=16;
+
+    /**
+     * @brief Is the compression of the records available in this build?
+     */
+    static constexpr bool compression(){
+        #ifdef SSAGI_ZSTD
+        return true;
+        #else
+        return false;
+        #endif
+    }
+
+    /**
+     * @brief Take the content of a sync.
+     * @param full the content, as it would be written by a full checkpoint.
+     * @param every how many syncs share the same snapshot.
+     * @param force should a new snapshot be taken regardless?
+     * @param compress are the records compressed?
+     * @return true if the content is a new snapshot, to be written in full with its log emptied, false if record() is to be appended to the log.
+     */
+    bool sync(const std::string& full, uint every, bool force, bool compress){
+        nlohmann::json now=nlohmann::json::parse(full);
+        if(force || base_text.empty() || since+1>=every){
+            base_text=full;
+            base_json=std::move(now);
+            base_key=to_hex(fnv1a64(base_text));
+            since=0;
+            fresh=true;
+            last.clear();
+            return true;
+        }
+        since++;
+        nlohmann::json payload;
+        payload["base"]=base_key;
+        payload["patch"]=nlohmann::json::diff(base_json,now);
+        last.clear();
+        _frame(payload.dump(),compress,last);
+        return false;
+    }
+
+    /**
+     * @brief The snapshot the records are patching.
+     */
+    inline const std::string& base() const{return base_text;}
+
+    /**
+     * @brief The framed record of the last sync, empty if it was a snapshot.
+     */
+    inline const std::string& record() const{return last;}
+
+    /**
+     * @brief Does the backup need the snapshot, as its copy patches an older one or the last sync took a new one? It is then assumed to be written.
+     */
+    inline bool backup_base(){
+        if(!fresh && copy_key==base_key)return false;
+        copy_key=base_key;
+        fresh=false;
+        return true;
+    }
+
+    /**
+     * @brief Rebuild the content of a file from its snapshot and its log.
+     * Records which are damaged or patch another snapshot are ignored, leaving the last valid one.
+     */
+    static nlohmann::json replay(const std::string& snapshot, std::string_view log){
+        nlohmann::json ret=nlohmann::json::parse(snapshot);
+        const std::string key=to_hex(fnv1a64(snapshot));
+        nlohmann::json patch;
+        for(size_t pos=0;pos+header_size<=log.size();){
+            uint32_t size,raw;
+            uint64_t checksum;
+            memcpy(&size,log.data()+pos,4);
+            memcpy(&raw,log.data()+pos+4,4);
+            memcpy(&checksum,log.data()+pos+8,8);
+            if(pos+header_size+size>log.size())break;
+            std::string_view payload=log.substr(pos+header_size,size);
+            pos+=header_size+size;
+            if(fnv1a64(payload)!=checksum)break;
+
+            try{
+                std::string text;
+                if(!_unframe(payload,raw,text))continue;
+                nlohmann::json record=nlohmann::json::parse(text);
+                if(record.value("base","")==key)patch=std::move(record["patch"]);
+            }
+            catch(...){
+                continue;
+            }
+        }
+        if(patch.is_array())ret=ret.patch(patch);
+        return ret;
+    }
+
+    private:
+        std::string     base_text;
+        nlohmann::json  base_json;
+        std::string     base_key;
+        std::string     copy_key;       ///< The snapshot of the backup copy.
+        uint            since=0;        ///< The syncs since the snapshot.
+        bool            fresh=false;    ///< Was the snapshot taken by the last sync, and not yet by a backup?
+        std::string     last;
+
+        static void _frame(const std::string& payload, [[maybe_unused]] bool compress, std::string& out){
+            std::string body;
+            uint32_t raw=0;
+            #ifdef SSAGI_ZSTD
+            if(compress){
+                body.resize(ZSTD_compressBound(payload.size()));
+                const size_t n=ZSTD_compress(body.data(),body.size(),payload.data(),payload.size(),3);
+                if(!ZSTD_isError(n) && n<payload.size()){
+                    body.resize(n);
+                    raw=payload.size();
+                }
+                else body=payload;
+            }
+            else body=payload;
+            #else
+            body=payload;
+            #endif
+
+            const uint32_t size=body.size();
+            const uint64_t checksum=fnv1a64(body);
+            out.append((const char*)&size,4);
+            out.append((const char*)&raw,4);
+            out.append((const char*)&checksum,8);
+            out.append(body);
+        }
+
+        static bool _unframe(std::string_view payload, uint32_t raw, std::string& out){
+            if(raw==0){
+                out.assign(payload);
+                return true;
+            }
+            #ifdef SSAGI_ZSTD
+            out.resize(raw);
+            const size_t n=ZSTD_decompress(out.data(),out.size(),payload.data(),payload.size());
+            return !ZSTD_isError(n) && n==raw;
+            #else
+            return false;
+            #endif
+        }
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+/**
+ * @file hashing.h
+ * @author karurochari
+ * @brief Small non-cryptographic hashes used for checksums and keys.
+ * @version 0.1
+ * @date 2020-06-26
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+/**
+ * @brief 64bit FNV-1a, optionally continuing from a previous hash.
+ */
+inline uint64_t fnv1a64(std::string_view data, uint64_t h=0xcbf29ce484222325ull){
+    for(unsigned char c:data){
+        h^=c;
+        h*=0x100000001b3ull;
+    }
+    return h;
+}
+
+/**
+ * @brief The finalizer of splitmix64, to spread the bits of a 64bit value.
+ */
+inline uint64_t mix64(uint64_t z){
+    z=(z^(z>>30))*0xbf58476d1ce4e5b9ull;
+    z=(z^(z>>27))*0x94d049bb133111ebull;
+    return z^(z>>31);
+}
+
+inline std::string to_hex(uint64_t v){
+    char buf[17];
+    snprintf(buf,sizeof(buf),"%016llx",(unsigned long long)v);
+    return buf;
+}
+
+/**
+ * @brief As to_hex, in a buffer of the caller so that nothing is allocated.
+ */
+inline std::string_view to_hex(uint64_t v, char (&buf)[17]){
+    snprintf(buf,sizeof(buf),"%016llx",(unsigned long long)v);
+    return std::string_view(buf,16);
+}
@@ -0,0 +1,464 @@
+#pragma once
+
+/**
+ * @file io-writer.h
+ * @author karurochari
+ * @brief Asynchronous persistence stage for the files written by the simulation threads.
+ * @version 0.1
+ * @date 2020-06-24
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "string-exception.h"
+#include "packed-workspace.h"
+#include "phase-metrics.h"
+
+/**
+ * @brief When written data is forced on the storage device.
+ * - `none` leaves it to the operating system.
+ * - `checkpoint` calls fsync after every write, and on the directory after every rename or link.
+ * - `group_commit` keeps the written files open and fsyncs them together, then the directories where they were renamed or linked, once the lane is idle or the commit interval expired, or as soon as sync() asks for it.
+ */
+enum class durability_t{none, checkpoint, group_commit};
+
+inline bool durability_from_string(const std::string& s, durability_t& d){
+    if(s=="none")d=durability_t::none;
+    else if(s=="checkpoint")d=durability_t::checkpoint;
+    else if(s=="group-commit")d=durability_t::group_commit;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief A pool of writer threads serving bounded queues of serialized buffers.
+ * Jobs are assigned to a lane based on their key, and each lane is served by a single thread, so all the jobs sharing a key are performed in order.
+ * Producers block when the queue of their lane is full.
+ */
+struct io_writer{
+    enum class op_t{
+        write,      ///< Replace the content of the file.
+        append,     ///< Append to the end of the file.
+        publish,    ///< Replace the content of the file atomically, writing it aside and renaming it over the old one.
+        link        ///< Make the file another name of the one whose path is the buffer, atomically replacing it. Not available in packed workspaces, submitted by link().
+    };
+
+    /**
+     * @param writers the number of writer threads.
+     * @param capacity the maximum number of pending jobs for each writer.
+     * @param d the durability policy.
+     * @param group_ms the maximum interval between two group commits.
+     * @param root the workspace, only needed for the packed layout.
+     * @param run the number of this run, only needed for the packed layout.
+     * @param packed should the files be stored in the segments of a packed workspace instead of their own paths?
+     */
+    io_writer(uint writers=1, uint capacity=256, durability_t d=durability_t::none, uint group_ms=50, const std::string& root="", uint32_t run=0, bool packed=false):capacity(capacity==0?1:capacity),durability(d),group_interval(group_ms){
+        if(writers==0)writers=1;
+        if(packed)store=std::make_unique<packed_store>(root,run,writers);
+        for(uint i=0;i<writers;i++){
+            lanes.emplace_back(std::make_unique<lane_t>());
+            lanes.back()->index=i;
+            lanes.back()->jobs.reserve(this->capacity);
+            lanes.back()->spare.reserve(this->capacity);
+            lanes.back()->paths.reserve(2*this->capacity);
+        }
+        for(auto& l:lanes)l->thread=std::thread(&io_writer::_serve,this,l.get());
+    }
+
+    io_writer(const io_writer&)=delete;
+
+    /**
+     * @brief When set, checked before performing each job: the jobs of a process which has lost the right to write its files are dropped.
+     */
+    std::function<bool()> fence;
+
+    ~io_writer(){
+        for(auto& l:lanes){
+            {
+                std::lock_guard<std::mutex> lock(l->m);
+                l->stop=true;
+            }
+            l->not_empty.notify_all();
+        }
+        for(auto& l:lanes)l->thread.join();
+    }
+
+    /**
+     * @brief Queue a buffer to be written. It blocks if the lane is full.
+     * The path is copied in a string recycled from the jobs already performed, so it does not allocate once the lane is warm.
+     * @param key jobs sharing the same key are performed in the same order they were submitted.
+     */
+    void submit(size_t key, op_t op, std::string_view path, std::string buffer){
+        lane_t& l=*lanes[key%lanes.size()];
+        std::unique_lock<std::mutex> lock(l.m);
+        l.not_full.wait(lock,[&](){return l.jobs.size()<capacity;});
+        l.jobs.push_back({op,_path(l,path),std::move(buffer)});
+        l.submitted++;
+        lock.unlock();
+        l.not_empty.notify_one();
+    }
+
+    /**
+     * @brief Queue a link of path to target, see op_t::link. Both are copied in recycled strings, as with submit.
+     */
+    void link(size_t key, std::string_view path, std::string_view target){
+        lane_t& l=*lanes[key%lanes.size()];
+        std::unique_lock<std::mutex> lock(l.m);
+        l.not_full.wait(lock,[&](){return l.jobs.size()<capacity;});
+        std::string p=_path(l,path);
+        l.jobs.push_back({op_t::link,std::move(p),_path(l,target)});
+        l.submitted++;
+        lock.unlock();
+        l.not_empty.notify_one();
+    }
+
+    /**
+     * @brief An empty buffer to be filled and submitted with this key, recycled from the jobs already performed when possible.
+     * Its capacity is kept, so producers refilling it with records of similar size do not allocate.
+     */
+    std::string acquire(size_t key){
+        lane_t& l=*lanes[key%lanes.size()];
+        std::lock_guard<std::mutex> lock(l.m);
+        if(l.spare.empty())return {};
+        std::string ret=std::move(l.spare.back());
+        l.spare.pop_back();
+        l.spare_bytes-=ret.capacity();
+        return ret;
+    }
+
+    /**
+     * @brief Wait until all the jobs submitted so far with this key have been performed, and are as durable as the policy makes them.
+     * With group commits the lane is asked to commit as soon as it has performed them, rather than waiting for the interval.
+     */
+    void sync(size_t key){
+        lane_t& l=*lanes[key%lanes.size()];
+        std::unique_lock<std::mutex> lock(l.m);
+        const uint64_t target=l.submitted;
+        if(durability==durability_t::group_commit){
+            l.flush=true;
+            l.not_empty.notify_one();
+            l.done.wait(lock,[&](){return l.completed>=target && l.committed>=target;});
+        }
+        else l.done.wait(lock,[&](){return l.completed>=target;});
+    }
+
+    /**
+     * @brief Wait until all the jobs submitted so far have been performed.
+     */
+    void drain(){
+        for(size_t i=0;i<lanes.size();i++)sync(i);
+    }
+
+    inline uint64_t bytes() const{return _bytes.load(std::memory_order_relaxed);}
+    inline uint64_t writes() const{return _writes.load(std::memory_order_relaxed);}
+    inline uint64_t fsyncs() const{return _fsyncs.load(std::memory_order_relaxed);}
+    inline uint64_t errors() const{return _errors.load(std::memory_order_relaxed);}
+    inline uint64_t fenced() const{return _fenced.load(std::memory_order_relaxed);}
+
+    private:
+        struct job_t{
+            op_t                    op;
+            std::string             path;
+            std::string             buffer;
+        };
+
+        /**
+         * @brief The pending jobs of a lane, in slots allocated once so that queueing never allocates.
+         */
+        struct job_ring{
+            inline void reserve(size_t n){slots.resize(n);}
+            inline size_t size() const{return count;}
+            inline bool empty() const{return count==0;}
+            inline job_t& front(){return slots[head];}
+            inline void push_back(job_t&& job){slots[(head+count++)%slots.size()]=std::move(job);}
+            inline void pop_front(){head=(head+1)%slots.size();count--;}
+
+            private:
+                std::vector<job_t>  slots;
+                size_t              head=0;
+                size_t              count=0;
+        };
+
+        struct lane_t{
+            std::mutex              m;
+            std::condition_variable not_empty;
+            std::condition_variable not_full;
+            std::condition_variable done;
+            job_ring                jobs;
+            std::vector<std::string> spare;         ///< Buffers of the performed jobs, ready to be reused.
+            size_t                  spare_bytes=0;  ///< The capacity of the spare buffers.
+            std::vector<std::string> paths;         ///< Paths of the performed jobs, ready to be reused.
+            uint64_t                submitted=0;
+            uint64_t                completed=0;
+            uint64_t                committed=0;    ///< The jobs covered by the last group commit.
+            bool                    flush=false;    ///< Has a sync asked for a group commit?
+            bool                    stop=false;
+            uint                    index=0;
+            std::thread             thread;
+        };
+
+        static constexpr size_t                 max_uncommitted=64; ///< Descriptors kept open at most while waiting for a group commit.
+        static constexpr size_t                 max_spare=16<<20;   ///< Bytes kept at most in the spare buffers of each lane.
+
+        uint                                    capacity;
+        durability_t                            durability;
+        std::chrono::milliseconds               group_interval;
+        std::vector<std::unique_ptr<lane_t>>    lanes;
+        std::unique_ptr<packed_store>           store;              ///< The segments, only for the packed layout.
+
+        std::atomic<uint64_t>                   _bytes=0;
+        std::atomic<uint64_t>                   _writes=0;
+        std::atomic<uint64_t>                   _fsyncs=0;
+        std::atomic<uint64_t>                   _errors=0;
+        std::atomic<uint64_t>                   _fenced=0;
+
+        void _serve(lane_t* _l){
+            lane_t& l=*_l;
+            std::vector<int> uncommitted;
+            std::vector<std::string> renamed;       //The directories with renames or links not yet committed.
+            bool segment_dirty=false;
+            uint64_t performed=0;
+            std::string tmp;                        //The temporary path of publish and link, reused across jobs.
+            auto last_commit=std::chrono::steady_clock::now();
+
+            auto commit=[&](){
+                if(!uncommitted.empty() || segment_dirty || !renamed.empty()){
+                    phase_scope timed(phase_t::fsync);
+                    for(int fd:uncommitted){fsync(fd);close(fd);}
+                    if(segment_dirty)_sync_segment(l.index);
+                    //The entries go after the files they name.
+                    for(auto& d:renamed)_sync_directory(d);
+                    _fsyncs++;
+                }
+                uncommitted.clear();
+                renamed.clear();
+                segment_dirty=false;
+                last_commit=std::chrono::steady_clock::now();
+                {
+                    std::lock_guard<std::mutex> lock(l.m);
+                    l.committed=performed;
+                }
+                l.done.notify_all();
+            };
+
+            for(;;){
+                std::unique_lock<std::mutex> lock(l.m);
+                if(l.jobs.empty() && (!uncommitted.empty() || segment_dirty || !renamed.empty())){
+                    //Wait for more jobs to be grouped, but not beyond the commit interval, nor once a sync is waiting for them.
+                    l.not_empty.wait_until(lock,last_commit+group_interval,[&](){return !l.jobs.empty() || l.stop || l.flush;});
+                }
+                else l.not_empty.wait(lock,[&](){return !l.jobs.empty() || l.stop || l.flush;});
+
+                if(l.jobs.empty()){
+                    l.flush=false;
+                    lock.unlock();
+                    commit();
+                    if(l.stop)return;
+                    continue;
+                }
+
+                job_t job=std::move(l.jobs.front());
+                l.jobs.pop_front();
+                lock.unlock();
+                l.not_full.notify_one();
+
+                if(fence && !fence())_fenced++;
+                else if(job.op==op_t::link){
+                    if(store || !_link(job,tmp))_errors++;
+                    else _renamed(job,tmp,renamed);
+                }
+                else if(store){
+                    //Records of the segments are only visible once indexed, so they are already published atomically.
+                    int ret;
+                    {
+                        phase_scope timed(phase_t::write);
+                        ret=store->append(l.index,job.path,job.op==op_t::append,job.buffer);
+                    }
+                    if(ret<0)_errors++;
+                    else{
+                        _bytes+=job.buffer.size();
+                        _writes++;
+                        phase_metrics::count(counter_t::bytes_written,job.buffer.size());
+                        if(durability==durability_t::group_commit)segment_dirty=true;
+                        else if(durability==durability_t::checkpoint){
+                            phase_scope timed(phase_t::fsync);
+                            _sync_segment(l.index);
+                            _fsyncs++;
+                        }
+                    }
+                }
+                else{
+                    int fd=_perform(job,tmp);
+                    if(fd>=0){
+                        if(job.op==op_t::publish)_renamed(job,tmp,renamed);
+                        if(durability==durability_t::group_commit)uncommitted.push_back(fd);
+                        else{
+                            //Published files were already forced on disk before being renamed.
+                            if(durability==durability_t::checkpoint && job.op!=op_t::publish){
+                                phase_scope timed(phase_t::fsync);
+                                fsync(fd);
+                                _fsyncs++;
+                            }
+                            close(fd);
+                        }
+                    }
+                }
+
+                performed++;
+                if(uncommitted.size()>=max_uncommitted || ((!uncommitted.empty() || segment_dirty || !renamed.empty()) && std::chrono::steady_clock::now()-last_commit>=group_interval)){
+                    commit();
+                }
+
+                //Group commits are reported as completed once written, before their fsync. Only sync() waits for their commit.
+                lock.lock();
+                _recycle(std::move(job.path),l.paths);
+                //Links hold a path as their buffer, which would only be grown by the next payload.
+                if(job.op==op_t::link)_recycle(std::move(job.buffer),l.paths);
+                else if(l.spare.size()<capacity && l.spare_bytes+job.buffer.capacity()<=max_spare && job.buffer.capacity()!=0){
+                    job.buffer.clear();
+                    l.spare_bytes+=job.buffer.capacity();
+                    l.spare.push_back(std::move(job.buffer));
+                }
+                l.completed++;
+                lock.unlock();
+                l.done.notify_all();
+            }
+        }
+
+        /**
+         * @brief A copy of a path, in a string recycled from the performed jobs. The lane must be locked.
+         */
+        std::string _path(lane_t& l, std::string_view path){
+            std::string ret;
+            if(!l.paths.empty()){
+                ret=std::move(l.paths.back());
+                l.paths.pop_back();
+            }
+            ret.assign(path);
+            return ret;
+        }
+
+        /**
+         * @brief Keep a path for a later job. Each job holds at most two of them.
+         */
+        void _recycle(std::string&& s, std::vector<std::string>& to){
+            if(to.size()>=2*capacity || s.capacity()==0)return;
+            s.clear();
+            to.push_back(std::move(s));
+        }
+
+        /**
+         * @brief Make the new name of a published or linked file durable as the policy asks: at once with checkpoints, with the next commit of the group otherwise.
+         * Without it the rename could be lost in a crash, even with the file itself on disk.
+         */
+        void _renamed(const job_t& job, std::string& tmp, std::vector<std::string>& pending){
+            if(durability==durability_t::none)return;
+            const size_t slash=job.path.rfind('/');
+            if(slash==std::string::npos)tmp.assign(".");
+            else tmp.assign(job.path,0,std::max<size_t>(1,slash));
+            if(durability==durability_t::checkpoint){
+                phase_scope timed(phase_t::fsync);
+                _sync_directory(tmp);
+                _fsyncs++;
+            }
+            else if(std::find(pending.begin(),pending.end(),tmp)==pending.end())pending.push_back(tmp);
+        }
+
+        void _sync_directory(const std::string& dir){
+            int fd=open(dir.c_str(),O_RDONLY|O_DIRECTORY);
+            if(fd<0){_errors++;return;}
+            fsync(fd);
+            close(fd);
+        }
+
+        void _sync_segment(uint lane){
+            //The segment is only reached through the index, so the segment goes first.
+            fdatasync(store->segment_fd(lane));
+            fdatasync(store->index_fd(lane));
+        }
+
+        /**
+         * @brief Write the job buffer with pwrite. A published file is written aside, and renamed once complete.
+         * @return the still open descriptor, or -1 on failure.
+         */
+        int _perform(const job_t& job, std::string& tmp){
+            int flags=O_WRONLY|O_CREAT|(job.op==op_t::append?O_APPEND:O_TRUNC);
+            if(job.op==op_t::publish)tmp.assign(job.path).append(".tmp");
+            const std::string& path=(job.op==op_t::publish)?tmp:job.path;
+            int fd;
+            {
+                phase_scope timed(phase_t::open);
+                fd=open(path.c_str(),flags,0644);
+            }
+            if(fd<0){_errors++;return -1;}
+            phase_metrics::count(counter_t::files_opened);
+
+            phase_scope timed(phase_t::write);
+
+            off_t offset=0;
+            if(job.op==op_t::append)offset=lseek(fd,0,SEEK_END);
+
+            size_t done=0;
+            for(;done<job.buffer.size();){
+                ssize_t w=pwrite(fd,job.buffer.data()+done,job.buffer.size()-done,offset+done);
+                if(w<0){
+                    if(errno==EINTR)continue;
+                    _errors++;
+                    close(fd);
+                    return -1;
+                }
+                done+=w;
+            }
+
+            _bytes+=done;
+            _writes++;
+            phase_metrics::count(counter_t::bytes_written,done);
+
+            if(job.op==op_t::publish){
+                //With group commits the rename comes before the fsync, as readers expect the file once the job is completed.
+                if(durability==durability_t::checkpoint){
+                    phase_scope timed(phase_t::fsync);
+                    fsync(fd);
+                    _fsyncs++;
+                }
+                if(rename(path.c_str(),job.path.c_str())!=0){
+                    _errors++;
+                    close(fd);
+                    return -1;
+                }
+            }
+            return fd;
+        }
+
+        /**
+         * @brief Link a file under a temporary name, and rename it over the destination.
+         */
+        bool _link(const job_t& job, std::string& tmp){
+            tmp.assign(job.path).append(".tmp");
+            unlink(tmp.c_str());
+            if(::link(job.buffer.c_str(),tmp.c_str())!=0)return false;
+            if(rename(tmp.c_str(),job.path.c_str())!=0){
+                unlink(tmp.c_str());
+                return false;
+            }
+            _writes++;
+            return true;
+        }
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+/**
+ * @file json-writer.h
+ * @author karurochari
+ * @brief Streaming JSON writer, to serialize states without building a document first.
+ * @version 0.1
+ * @date 2020-07-10
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstdint>
+#include <cmath>
+#include <type_traits>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief SAX-style writer appending JSON text to a caller owned buffer.
+ * Separators are handled by the writer, so a state can be written as
+ * ```
+ * w.begin_object().key("x").value(s.x).key("v").begin_array();
+ * for(auto& i:s.v)w.value(i);
+ * w.end_array().end_object();
+ * ```
+ * Nothing is allocated besides the growth of the buffer, so reusing the same buffer makes it allocation free once warm.
+ * Nesting is limited to 64 levels.
+ */
+struct json_writer{
+    json_writer(std::string& _out):out(_out){}
+
+    inline json_writer& begin_object(){_separator();out.push_back('{');_push();return *this;}
+    inline json_writer& end_object(){depth--;out.push_back('}');return *this;}
+    inline json_writer& begin_array(){_separator();out.push_back('[');_push();return *this;}
+    inline json_writer& end_array(){depth--;out.push_back(']');return *this;}
+
+    inline json_writer& key(std::string_view k){
+        _separator();
+        _string(k);
+        out.push_back(':');
+        after_key=true;
+        return *this;
+    }
+
+    inline json_writer& null(){_separator();out.append("null");return *this;}
+
+    inline json_writer& value(bool v){_separator();out.append(v?"true":"false");return *this;}
+
+    inline json_writer& value(std::string_view v){_separator();_string(v);return *this;}
+    inline json_writer& value(const char* v){return value(std::string_view(v));}
+    inline json_writer& value(const std::string& v){return value(std::string_view(v));}
+
+    template<typename N> requires std::is_arithmetic_v<N>
+    json_writer& value(N v){
+        if constexpr(std::is_floating_point_v<N>){
+            //Like nlohmann::json, values without a JSON representation are written as null.
+            if(!std::isfinite(v))return null();
+        }
+        _separator();
+        char buf[32];
+        auto r=std::to_chars(buf,buf+sizeof(buf),v);
+        out.append(buf,r.ptr);
+        return *this;
+    }
+
+    /**
+     * @brief Append a value which is already JSON text.
+     */
+    inline json_writer& raw(std::string_view v){_separator();out.append(v);return *this;}
+
+    private:
+        std::string&    out;
+        uint64_t        nonempty=0;     ///< One bit for each nesting level, set once it has its first element.
+        uint            depth=0;
+        bool            after_key=false;
+
+        inline void _push(){
+            depth++;
+            nonempty&=~(1ull<<(depth&63));
+        }
+
+        inline void _separator(){
+            if(after_key){after_key=false;return;}
+            if(depth==0)return;
+            const uint64_t bit=1ull<<(depth&63);
+            if(nonempty&bit)out.push_back(',');
+            else nonempty|=bit;
+        }
+
+        void _string(std::string_view s){
+            static const char hex[]="0123456789abcdef";
+            out.push_back('"');
+            for(unsigned char c:s){
+                switch(c){
+                    case '"': out.append("\\\"");break;
+                    case '\\': out.append("\\\\");break;
+                    case '\n': out.append("\\n");break;
+                    case '\r': out.append("\\r");break;
+                    case '\t': out.append("\\t");break;
+                    default:
+                        if(c<0x20){
+                            out.append("\\u00");
+                            out.push_back(hex[c>>4]);
+                            out.push_back(hex[c&15]);
+                        }
+                        else out.push_back(c);
+                }
+            }
+            out.push_back('"');
+        }
+};
+
+/**
+ * @brief A type which can be written by a json_writer, besides its usual to_json, by providing
+ * ```
+ * friend void serialize(json_writer& w, const T& t);
+ * ```
+ * The text it writes must be read back by its from_json.
+ */
+template<typename T>
+concept StreamSerializableType = requires(json_writer& w, const T& t){
+    serialize(w,t);
+};
+
+/**
+ * @brief Write a value with its serialize when available, otherwise going through its to_json.
+ */
+template<typename T>
+void write_json(json_writer& w, const T& t){
+    if constexpr(StreamSerializableType<T>)serialize(w,t);
+    else{
+        nlohmann::json tmp;
+        to_json(tmp,t);
+        w.raw(tmp.dump());
+    }
+}
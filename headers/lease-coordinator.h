@@ -0,0 +1,566 @@
+#pragma once
+
+/**
+ * @file lease-coordinator.h
+ * @author karurochari
+ * @brief Distribute the instances of a run to worker processes, possibly on other machines, through leases over a socket.
+ * @version 0.1
+ * @date 2020-07-16
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "string-exception.h"
+#include "process-queue.h"
+#include "manifest.h"
+
+/**
+ * @brief The endpoint of the coordinator, as `unix:/path/of/socket` or `tcp:host:port`.
+ * The protocol is made of text lines, and each request of a worker gets exactly one response:
+ * ```
+ * LEASE                                    -> JOBS lease k, followed by k lines "batch first count attempt" | WAIT | DONE
+ * RESULT lease batch first ret n           -> OK, the request is followed by n lines for the manifest
+ * ALIVE                                    -> OK, extending all the leases of the worker
+ * ```
+ */
+struct lease_endpoint{
+    /**
+     * @brief Open the socket of the coordinator.
+     */
+    static int listen(const std::string& address){
+        int fd=_socket(address,true);
+        if(::listen(fd,64)<0){close(fd);throw StringException("SocketListenException");}
+        return fd;
+    }
+
+    /**
+     * @brief Connect a worker to the coordinator, waiting for it to be up for a while.
+     */
+    static int connect(const std::string& address, std::chrono::milliseconds patience=std::chrono::milliseconds(10000)){
+        const auto until=std::chrono::steady_clock::now()+patience;
+        for(;;){
+            try{return _socket(address,false);}
+            catch(...){
+                if(std::chrono::steady_clock::now()>until)throw;
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+        }
+    }
+
+    /**
+     * @brief Write all of a buffer, without raising SIGPIPE if the other side is gone.
+     */
+    static bool send_all(int fd, const std::string& data){
+        for(size_t done=0;done<data.size();){
+            ssize_t w=::send(fd,data.data()+done,data.size()-done,MSG_NOSIGNAL);
+            if(w<0){
+                if(errno==EINTR)continue;
+                return false;
+            }
+            done+=w;
+        }
+        return true;
+    }
+
+    /**
+     * @brief Buffered reading of whole lines.
+     */
+    struct line_reader{
+        int         fd=-1;
+        std::string buffer;
+
+        /**
+         * @brief Extract a line already received, without blocking.
+         */
+        bool take(std::string& line){
+            auto pos=buffer.find('\n');
+            if(pos==std::string::npos)return false;
+            line=buffer.substr(0,pos);
+            buffer.erase(0,pos+1);
+            return true;
+        }
+
+        /**
+         * @brief Receive what is available. Returns false once the other side is gone.
+         */
+        bool fill(){
+            char tmp[4096];
+            for(;;){
+                ssize_t r=::recv(fd,tmp,sizeof(tmp),0);
+                if(r<0 && errno==EINTR)continue;
+                if(r<=0)return false;
+                buffer.append(tmp,r);
+                return true;
+            }
+        }
+
+        /**
+         * @brief Block until a whole line is there. Returns false once the other side is gone.
+         */
+        bool get(std::string& line){
+            for(;!take(line);){
+                if(!fill())return false;
+            }
+            return true;
+        }
+    };
+
+    private:
+        static int _socket(const std::string& address, bool server){
+            if(address.rfind("unix:",0)==0){
+                const std::string path=address.substr(5);
+                sockaddr_un sa{};
+                sa.sun_family=AF_UNIX;
+                if(path.size()>=sizeof(sa.sun_path))throw StringException("SocketAddressException");
+                strncpy(sa.sun_path,path.c_str(),sizeof(sa.sun_path)-1);
+                int fd=socket(AF_UNIX,SOCK_STREAM,0);
+                if(fd<0)throw StringException("SocketException");
+                if(server){
+                    unlink(path.c_str());
+                    if(bind(fd,(sockaddr*)&sa,sizeof(sa))<0){close(fd);throw StringException("SocketBindException");}
+                }
+                else if(::connect(fd,(sockaddr*)&sa,sizeof(sa))<0){close(fd);throw StringException("SocketConnectException");}
+                return fd;
+            }
+            if(address.rfind("tcp:",0)==0){
+                const std::string rest=address.substr(4);
+                const auto colon=rest.rfind(':');
+                if(colon==std::string::npos)throw StringException("SocketAddressException");
+                addrinfo hints{}, *res=nullptr;
+                hints.ai_family=AF_UNSPEC;
+                hints.ai_socktype=SOCK_STREAM;
+                if(server)hints.ai_flags=AI_PASSIVE;
+                if(getaddrinfo(rest.substr(0,colon).c_str(),rest.substr(colon+1).c_str(),&hints,&res)!=0)throw StringException("SocketAddressException");
+                int fd=-1;
+                for(addrinfo* a=res;a!=nullptr;a=a->ai_next){
+                    fd=socket(a->ai_family,a->ai_socktype,a->ai_protocol);
+                    if(fd<0)continue;
+                    if(server){
+                        int one=1;
+                        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+                        if(bind(fd,a->ai_addr,a->ai_addrlen)==0)break;
+                    }
+                    else if(::connect(fd,a->ai_addr,a->ai_addrlen)==0)break;
+                    close(fd);
+                    fd=-1;
+                }
+                freeaddrinfo(res);
+                if(fd<0)throw StringException(server?"SocketBindException":"SocketConnectException");
+                return fd;
+            }
+            throw StringException("SocketAddressException");
+        }
+};
+
+/**
+ * @brief The coordinator: it expands the generator into jobs, and leases them in chunks to the workers connected.
+ * A lease expires when nothing is heard from its worker for longer than the lease time, even once it has disconnected, as a worker cut off could still be running.
+ * The jobs of an expired lease are issued again, to be resumed from their backup copies, up to a maximum number of attempts.
+ * Workers stop writing before the lease could expire, see lease_client::holds(), so two attempts of a job never write its files at the same time.
+ * The manifest lines of the completed jobs are written by the coordinator, only from the results of the lease holding them: those of expired leases are ignored.
+ * @tparam T the generator type, whose iterators expose `key()` returning a process_job_t.
+ */
+template <typename T>
+struct lease_coordinator{
+    /**
+     * @param _address where the workers connect.
+     * @param _chunk the number of jobs in each lease.
+     * @param lease_ms how long a silent worker keeps its lease.
+     * @param retries how many times a job whose lease expired is issued again.
+     */
+    lease_coordinator(const std::string& _address, uint _chunk=4, uint lease_ms=30000, uint retries=2):address(_address),chunk(_chunk==0?1:_chunk),lease_time(lease_ms),max_retries(retries){}
+
+    /**
+     * @brief Serve the workers until all the jobs are completed or failed.
+     * @param manifest where the completions reported by the workers are recorded, optional.
+     * @return the number of failed jobs.
+     */
+    int operator()(const T& cc, const completion_manifest* manifest, bool verbose=true, std::ostream& out=std::cout, std::ostream& err=std::cerr){
+        auto ii=cc.begin();
+        const auto ee=cc.end();
+        uint bad_counter=0;
+        int server=lease_endpoint::listen(address);
+        if(verbose)out<<"Coordinator listening on ["<<address<<"]\n";
+
+        std::map<int,lease_endpoint::line_reader> clients;
+        std::map<uint64_t,lease_t> leases;
+        std::deque<entry_t> pending;
+        uint64_t next_lease=0;
+        uint next_id=0;
+
+        auto requeue=[&](lease_t& l, const char* why){
+            for(auto& e:l.jobs){
+                if(e.job.attempt<max_retries){
+                    entry_t again=e;
+                    again.job.attempt++;
+                    pending.push_front(again);
+                }
+                else{
+                    bad_counter++;
+                    err<<"Task ["<<e.id<<"] was lost too many times, it will not be attempted again.\n";
+                }
+            }
+            if(verbose && !l.jobs.empty())err<<"Lease ["<<l.id<<"] "<<why<<", ["<<l.jobs.size()<<"] tasks will be issued again.\n";
+        };
+
+        //The leases of a worker gone are left to expire, it could still be writing. They are detached, as the descriptor can be reused by a new worker.
+        auto drop=[&](int fd){
+            for(auto& [k,l]:leases){
+                if(l.fd==fd)l.fd=-1;
+            }
+            close(fd);
+            clients.erase(fd);
+        };
+
+        auto exhausted=[&](){return pending.empty() && !(ii!=ee);};
+
+        for(;!(exhausted() && leases.empty());){
+            std::vector<pollfd> fds;
+            fds.push_back({server,POLLIN,0});
+            for(auto& [fd,r]:clients)fds.push_back({fd,POLLIN,0});
+            poll(fds.data(),fds.size(),100);
+
+            const auto now=std::chrono::steady_clock::now();
+            if(fds[0].revents&POLLIN){
+                int fd=accept(server,nullptr,nullptr);
+                if(fd>=0)clients[fd].fd=fd;
+            }
+
+            for(size_t i=1;i<fds.size();i++){
+                if(fds[i].revents==0)continue;
+                const int fd=fds[i].fd;
+                auto& reader=clients[fd];
+                if(!reader.fill()){drop(fd);continue;}
+
+                //Any message from a worker keeps its leases alive.
+                for(auto& [k,l]:leases){
+                    if(l.fd==fd)l.deadline=now+lease_time;
+                }
+
+                for(std::string line;;){
+                    //A result is only processed once all its manifest lines are there.
+                    const std::string saved=reader.buffer;
+                    if(!reader.take(line))break;
+                    std::istringstream req(line);
+                    std::string verb;
+                    req>>verb;
+
+                    if(verb=="LEASE"){
+                        std::vector<entry_t> jobs;
+                        for(;jobs.size()<chunk && !exhausted();){
+                            entry_t e;
+                            if(!pending.empty()){e=pending.front();pending.pop_front();}
+                            else{e.job=ii.key();e.id=next_id++;++ii;}
+                            jobs.push_back(e);
+                        }
+                        std::string res;
+                        if(!jobs.empty()){
+                            lease_t& l=leases[next_lease];
+                            l.id=next_lease++;
+                            l.fd=fd;
+                            l.deadline=now+lease_time;
+                            l.jobs=jobs;
+                            res="JOBS "+std::to_string(l.id)+" "+std::to_string(jobs.size())+"\n";
+                            for(auto& e:jobs){
+                                res+=std::to_string(e.job.batch)+" "+std::to_string(e.job.first)+" "+std::to_string(e.job.count)+" "+std::to_string(e.job.attempt)+"\n";
+                                if(verbose)out<<"Started   ["<<e.id<<"]\tlease ["<<l.id<<"]\n";
+                            }
+                        }
+                        else if(leases.empty())res="DONE\n";
+                        else res="WAIT\n";
+                        lease_endpoint::send_all(fd,res);
+                    }
+                    else if(verb=="RESULT"){
+                        uint64_t lid;
+                        uint32_t batch, first;
+                        int ret;
+                        size_t n;
+                        req>>lid>>batch>>first>>ret>>n;
+                        std::vector<std::string> lines;
+                        for(std::string l;lines.size()<n && reader.take(l);)lines.push_back(l);
+                        if(lines.size()<n){reader.buffer=saved;break;}
+
+                        //A result of an expired lease is ignored, its job was issued again and its files are being written by the new attempt.
+                        bool held=false;
+                        auto lit=leases.find(lid);
+                        if(lit!=leases.end()){
+                            auto& jobs=lit->second.jobs;
+                            for(auto it=jobs.begin();it!=jobs.end();it++){
+                                if(it->job.batch==batch && it->job.first==first){
+                                    if(verbose)out<<"Completed ["<<it->id<<"]\tin lease ["<<lid<<"]. Returned ["<<ret<<"]\n";
+                                    jobs.erase(it);
+                                    held=true;
+                                    break;
+                                }
+                            }
+                            if(jobs.empty())leases.erase(lit);
+                        }
+                        if(held){
+                            if(ret!=0)bad_counter++;
+                            if(manifest!=nullptr)for(auto& l:lines)manifest->append_line(l);
+                        }
+                        else if(verbose)err<<"Result of lease ["<<lid<<"] ignored, it had expired.\n";
+                        lease_endpoint::send_all(fd,"OK\n");
+                    }
+                    else if(verb=="ALIVE"){
+                        lease_endpoint::send_all(fd,"OK\n");
+                    }
+                }
+            }
+
+            for(auto it=leases.begin();it!=leases.end();){
+                if(it->second.deadline<now){requeue(it->second,"expired");it=leases.erase(it);}
+                else it++;
+            }
+
+        }
+
+        for(auto& [fd,r]:clients)close(fd);
+        close(server);
+        if(address.rfind("unix:",0)==0)unlink(address.substr(5).c_str());
+
+        if(verbose && bad_counter!=0){
+            out<<"Queue completed. ["<<bad_counter<<"] tasks failed.";
+        }
+        return bad_counter;
+    }
+
+    private:
+        struct entry_t{
+            process_job_t   job;
+            uint            id=0;
+        };
+
+        struct lease_t{
+            uint64_t                                id=0;
+            int                                     fd=-1;          ///< The connection of its worker, -1 once it is gone.
+            std::chrono::steady_clock::time_point   deadline;
+            std::vector<entry_t>                    jobs;
+        };
+
+        std::string                 address;
+        uint                        chunk;
+        std::chrono::milliseconds   lease_time;
+        uint                        max_retries;
+};
+
+/**
+ * @brief The worker side: a generator of tasks leased from the coordinator, to be run by a workers_queue.
+ * Each task runs its job and reports the result, along with the manifest lines recorded meanwhile by its thread.
+ * A background thread keeps the leases alive while long jobs are running.
+ * When the coordinator has nothing to lease yet while jobs of this worker are still running, the generator ends, since those jobs could be the ones waited for:
+ * the queue should be run again until finished() is true.
+ * There is at most one client in a process, as whether its leases are still held is known to the whole process through holds().
+ */
+struct lease_client{
+    typedef std::function<int(const process_job_t&)> runner_t;
+
+    /**
+     * @param address the endpoint of the coordinator.
+     * @param _runner what performs a job.
+     * @param lease_ms the lease time of the coordinator, the worker reports to be alive three times as often.
+     */
+    lease_client(const std::string& address, runner_t _runner, uint lease_ms=30000):runner(std::move(_runner)),margin(std::chrono::milliseconds(lease_ms)/2){
+        valid_until=0;
+        reader.fd=lease_endpoint::connect(address);
+        heartbeat=std::thread([this,lease_ms](){
+            std::unique_lock<std::mutex> lock(stop_m);
+            for(;!stopping;){
+                stop_cv.wait_for(lock,std::chrono::milliseconds(std::max(1u,lease_ms/3)));
+                if(stopping)break;
+                std::string res;
+                _exchange("ALIVE\n",res);
+            }
+        });
+    }
+
+    lease_client(const lease_client&)=delete;
+
+    ~lease_client(){
+        {
+            std::lock_guard<std::mutex> lock(stop_m);
+            stopping=true;
+        }
+        stop_cv.notify_all();
+        heartbeat.join();
+        close(reader.fd);
+        valid_until=unbounded;
+    }
+
+    /**
+     * @brief Are the leases of this process surely still held, so that their jobs can write their files?
+     * The coordinator keeps a lease for lease-ms after the last message it received from the worker, so a lease is held for half of that
+     * after sending the last request which was answered. The other half is left for the writes already queued to be performed.
+     * Processes which are not workers of a distributed run always hold their jobs.
+     */
+    static bool holds(){
+        const int64_t until=valid_until.load(std::memory_order_relaxed);
+        return until==unbounded || std::chrono::steady_clock::now().time_since_epoch().count()<until;
+    }
+
+    /**
+     * @brief Where the manifest lines of the job running on this thread are collected, see completion_manifest::forward.
+     */
+    static inline thread_local std::vector<std::string> captured;
+
+    struct const_iterator{
+        const lease_client* c;
+        bool                sentinel;
+
+        std::function<int()> operator*() const{
+            auto job=c->jobs.front();
+            const lease_client* client=c;
+            client->inflight++;
+            return [client,job]()->int{
+                //Jobs leased before the leases were lost are left to the attempts which replace them.
+                if(!holds()){
+                    client->inflight--;
+                    return 1;
+                }
+                captured.clear();
+                int ret=1;
+                try{ret=client->runner(job.second);}
+                catch(...){
+                    client->_report(job.first,job.second,1);
+                    client->inflight--;
+                    throw;
+                }
+                client->_report(job.first,job.second,ret);
+                client->inflight--;
+                return ret;
+            };
+        }
+        const_iterator& operator++(){c->jobs.pop_front();return *this;}
+        friend bool operator!=(const const_iterator& a, const const_iterator& b){return a._more(b);}
+
+        private:
+            /**
+             * @brief Only the end is ever compared against, and reaching it means asking the coordinator.
+             */
+            bool _more(const const_iterator& b) const{return (sentinel?b.c:c)->_available();}
+    };
+
+    const_iterator begin() const{return {this,false};}
+    const_iterator end() const{return {this,true};}
+
+    /**
+     * @brief Has the coordinator run out of jobs, or has it gone away?
+     */
+    inline bool finished() const{std::lock_guard<std::mutex> lock(m);return done && jobs.empty();}
+
+    private:
+        runner_t                                                runner;
+        mutable lease_endpoint::line_reader                     reader;
+        mutable std::mutex                                      m;          ///< One exchange at a time on the connection.
+        mutable std::deque<std::pair<uint64_t,process_job_t>>   jobs;       ///< The leased jobs not yet started, with their lease.
+        mutable bool                                            done=false;
+        mutable std::atomic<uint>                               inflight=0; ///< The jobs handed out and not yet reported.
+
+        std::chrono::nanoseconds                                margin;     ///< How long a lease is held after sending a request which is answered.
+
+        static constexpr int64_t                                unbounded=std::numeric_limits<int64_t>::max();
+        static inline std::atomic<int64_t>                      valid_until=unbounded;  ///< Until when the leases of this process are held, on the steady clock.
+
+        std::thread                                             heartbeat;
+        std::mutex                                              stop_m;
+        std::condition_variable                                 stop_cv;
+        bool                                                    stopping=false;
+
+        /**
+         * @brief Send a request and wait for the first line of its response.
+         */
+        bool _exchange(const std::string& req, std::string& res) const{
+            std::lock_guard<std::mutex> lock(m);
+            if(done)return false;
+            const auto sent=std::chrono::steady_clock::now();
+            if(!lease_endpoint::send_all(reader.fd,req) || !reader.get(res)){_lost();return false;}
+            _extend(sent);
+            return true;
+        }
+
+        /**
+         * @brief The coordinator has received a request sent at this time, its leases are extended at least until lease-ms after it.
+         */
+        void _extend(std::chrono::steady_clock::time_point sent) const{
+            const int64_t until=(sent+margin).time_since_epoch().count();
+            for(int64_t now=valid_until.load();now<until && !valid_until.compare_exchange_weak(now,until););
+        }
+
+        /**
+         * @brief The coordinator is gone, and the leases with it.
+         */
+        void _lost() const{
+            done=true;
+            valid_until=0;
+        }
+
+        bool _available() const{
+            for(;jobs.empty() && !done;){
+                bool wait=false;
+                {
+                    std::lock_guard<std::mutex> lock(m);
+                    std::string res;
+                    const auto sent=std::chrono::steady_clock::now();
+                    if(!lease_endpoint::send_all(reader.fd,"LEASE\n") || !reader.get(res)){_lost();break;}
+                    _extend(sent);
+                    std::istringstream in(res);
+                    std::string verb;
+                    in>>verb;
+                    if(verb=="JOBS"){
+                        uint64_t lease;
+                        size_t k;
+                        in>>lease>>k;
+                        for(size_t i=0;i<k;i++){
+                            std::string line;
+                            if(!reader.get(line)){_lost();break;}
+                            std::istringstream f(line);
+                            process_job_t j;
+                            f>>j.batch>>j.first>>j.count>>j.attempt;
+                            jobs.push_back({lease,j});
+                        }
+                    }
+                    //Other workers hold the last leases, which could still come back.
+                    else if(verb=="WAIT")wait=true;
+                    else done=true;
+                }
+                if(wait){
+                    if(inflight>0)break;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                }
+            }
+            return !jobs.empty();
+        }
+
+        void _report(uint64_t lease, const process_job_t& job, int ret) const{
+            std::string req="RESULT "+std::to_string(lease)+" "+std::to_string(job.batch)+" "+std::to_string(job.first)+" "+std::to_string(ret)+" "+std::to_string(captured.size())+"\n";
+            for(auto& l:captured)req+=l+"\n";
+            captured.clear();
+            std::string res;
+            _exchange(req,res);
+        }
+};
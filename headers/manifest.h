@@ -0,0 +1,100 @@
+#pragma once
+
+/**
+ * @file manifest.h
+ * @author karurochari
+ * @brief Append-only record of the completed instances of a workspace.
+ * @version 0.1
+ * @date 2020-06-26
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <unordered_set>
+#include <cstdint>
+#include <functional>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "string-exception.h"
+#include "hashing.h"
+
+/**
+ * @brief The manifest is a text file, one line for each completed instance:
+ * ```
+ * batch/id <TAB> exit code <TAB> steps <TAB> checksum of the final status
+ * ```
+ * Lines are appended with a single write on a descriptor opened in append mode, so concurrent tasks never interleave them.
+ */
+struct completion_manifest{
+    completion_manifest(const std::string& _file):file(_file){}
+
+    completion_manifest(const completion_manifest&)=delete;
+
+    ~completion_manifest(){if(fd>=0)close(fd);}
+
+    /**
+     * @brief Load the instances already completed successfully.
+     * @return the number of completed instances found.
+     */
+    size_t load(){
+        std::ifstream in(file);
+        for(std::string line;std::getline(in,line);){
+            std::istringstream fields(line);
+            std::string name;
+            int exit_code;
+            if(std::getline(fields,name,'\t') && (fields>>exit_code) && exit_code==0)finished.insert(name);
+        }
+        return finished.size();
+    }
+
+    /**
+     * @brief Open the manifest to record new completions.
+     * @param _durable should each record be forced on disk?
+     */
+    void open_for_append(bool _durable){
+        durable=_durable;
+        fd=open(file.c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+        if(fd<0)throw StringException("ManifestOpenException");
+    }
+
+    /**
+     * @brief Append the record of a completed instance.
+     */
+    void record(const std::string& name, int exit_code, uint64_t steps, uint64_t checksum) const{
+        std::string line=name+"\t"+std::to_string(exit_code)+"\t"+std::to_string(steps)+"\t"+to_hex(checksum);
+        if(forward){forward(line);return;}
+        append_line(line);
+    }
+
+    /**
+     * @brief Append a record already formatted, without its newline, as received from a remote worker.
+     */
+    void append_line(std::string line) const{
+        if(fd<0)return;
+        line.push_back('\n');
+        if(write(fd,line.data(),line.size())!=(ssize_t)line.size())throw StringException("ManifestWriteException");
+        if(durable)fsync(fd);
+    }
+
+    /**
+     * @brief Was this instance successfully completed by a previous run?
+     */
+    inline bool completed(const std::string& name) const{return !finished.empty() && finished.count(name)!=0;}
+
+    /**
+     * @brief When set, records are handed to it instead of being written, as the workers of a coordinator do.
+     */
+    std::function<void(const std::string&)> forward;
+
+    private:
+        std::string                         file;
+        std::unordered_set<std::string>     finished;
+        int                                 fd=-1;
+        bool                                durable=false;
+};
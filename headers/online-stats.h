@@ -0,0 +1,335 @@
+#pragma once
+
+/**
+ * @file online-stats.h
+ * @author karurochari
+ * @brief Streaming and mergeable statistics, to aggregate observables across the instances of a batch.
+ * @version 0.1
+ * @date 2020-07-06
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <vector>
+#include <map>
+#include <optional>
+#include <span>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief Count, mean, variance and range of a stream of values (Welford), which can be merged with others (Chan et al.).
+ */
+struct running_moments{
+    uint64_t    count=0;
+    double      mean=0;
+    double      m2=0;
+    double      min=std::numeric_limits<double>::infinity();
+    double      max=-std::numeric_limits<double>::infinity();
+
+    inline void add(double x){
+        count++;
+        const double d=x-mean;
+        mean+=d/count;
+        m2+=d*(x-mean);
+        if(x<min)min=x;
+        if(x>max)max=x;
+    }
+
+    void merge(const running_moments& o){
+        if(o.count==0)return;
+        if(count==0){*this=o;return;}
+        const uint64_t n=count+o.count;
+        const double d=o.mean-mean;
+        mean+=d*o.count/n;
+        m2+=o.m2+d*d*((double)count*o.count/n);
+        count=n;
+        if(o.min<min)min=o.min;
+        if(o.max>max)max=o.max;
+    }
+
+    /**
+     * @brief The unbiased sample variance.
+     */
+    inline double variance() const{return count>1?m2/(count-1):0;}
+
+    friend void to_json(nlohmann::json& j, const running_moments& m){
+        j=nlohmann::json{{"count",m.count},{"mean",m.mean},{"variance",m.variance()}};
+        if(m.count!=0){j["min"]=m.min;j["max"]=m.max;}
+    }
+
+    /**
+     * @brief The exact state, to be restored and merged later, unlike the report of to_json.
+     */
+    nlohmann::json save() const{
+        if(count==0)return nlohmann::json::array();
+        return nlohmann::json::array({count,mean,m2,min,max});
+    }
+
+    void restore(const nlohmann::json& j){
+        *this=running_moments();
+        if(j.size()!=5)return;
+        count=j[0];
+        mean=j[1];
+        m2=j[2];
+        min=j[3];
+        max=j[4];
+    }
+};
+
+/**
+ * @brief Quantile sketch with relative accuracy on the values (DDSketch, Masson et al.).
+ * Values are counted in logarithmic buckets, so two sketches are merged by adding their buckets.
+ */
+struct quantile_sketch{
+    /**
+     * @param accuracy the maximum relative error of the quantiles.
+     */
+    quantile_sketch(double accuracy=0.01):gamma((1+accuracy)/(1-accuracy)),log_gamma(std::log(gamma)){}
+
+    inline void add(double x){
+        count++;
+        if(std::fabs(x)<min_value)zeros++;
+        else if(x>0)positive[_index(x)]++;
+        else negative[_index(-x)]++;
+    }
+
+    void merge(const quantile_sketch& o){
+        count+=o.count;
+        zeros+=o.zeros;
+        for(auto& [k,v]:o.positive)positive[k]+=v;
+        for(auto& [k,v]:o.negative)negative[k]+=v;
+    }
+
+    /**
+     * @brief The estimated q-quantile, with q in [0,1].
+     */
+    double quantile(double q) const{
+        if(count==0)return std::numeric_limits<double>::quiet_NaN();
+        const uint64_t rank=(uint64_t)(q*(count-1));
+        uint64_t seen=0;
+        for(auto it=negative.rbegin();it!=negative.rend();it++){
+            seen+=it->second;
+            if(seen>rank)return -_value(it->first);
+        }
+        seen+=zeros;
+        if(seen>rank)return 0;
+        for(auto& [k,v]:positive){
+            seen+=v;
+            if(seen>rank)return _value(k);
+        }
+        return _value(positive.rbegin()->first);
+    }
+
+    /**
+     * @brief The exact state, as the buckets and their counts. The accuracy is not part of it.
+     */
+    nlohmann::json save() const{
+        return nlohmann::json{{"count",count},{"zeros",zeros},{"positive",positive},{"negative",negative}};
+    }
+
+    void restore(const nlohmann::json& j){
+        count=j.value("count",(uint64_t)0);
+        zeros=j.value("zeros",(uint64_t)0);
+        positive.clear();
+        negative.clear();
+        for(auto& [k,v]:j.value("positive",std::map<int,uint64_t>()))positive[k]=v;
+        for(auto& [k,v]:j.value("negative",std::map<int,uint64_t>()))negative[k]=v;
+    }
+
+    private:
+        static constexpr double     min_value=1e-300;
+
+        double                      gamma;
+        double                      log_gamma;
+        uint64_t                    count=0;
+        uint64_t                    zeros=0;
+        std::map<int,uint64_t>      positive;
+        std::map<int,uint64_t>      negative;
+
+        inline int _index(double x) const{return (int)std::ceil(std::log(x)/log_gamma);}
+        inline double _value(int i) const{return 2*std::pow(gamma,i)/(gamma+1);}
+};
+
+/**
+ * @brief The aggregates of a set of observables, for each bin of simulation steps.
+ */
+struct ensemble_stats{
+    struct cell_t{
+        running_moments     moments;
+        quantile_sketch     sketch;
+    };
+
+    ensemble_stats(size_t _observables=0, double _accuracy=0.01):observables(_observables),accuracy(_accuracy){}
+
+    /**
+     * @brief Add one sample of all the observables to a bin.
+     */
+    void add(size_t bin, std::span<const double> values){
+        if(bin>=bins.size())bins.resize(bin+1,std::vector<cell_t>(observables,cell_t{{},quantile_sketch(accuracy)}));
+        auto& b=bins[bin];
+        for(size_t i=0;i<observables && i<values.size();i++){
+            b[i].moments.add(values[i]);
+            b[i].sketch.add(values[i]);
+        }
+    }
+
+    void merge(const ensemble_stats& o){
+        if(o.bins.size()>bins.size())bins.resize(o.bins.size(),std::vector<cell_t>(observables,cell_t{{},quantile_sketch(accuracy)}));
+        for(size_t i=0;i<o.bins.size();i++){
+            for(size_t j=0;j<observables;j++){
+                bins[i][j].moments.merge(o.bins[i][j].moments);
+                bins[i][j].sketch.merge(o.bins[i][j].sketch);
+            }
+        }
+    }
+
+    inline bool empty() const{return bins.empty();}
+    inline void clear(){bins.clear();}
+    inline size_t size() const{return observables;}     ///< The number of observables in each bin.
+
+    /**
+     * @brief Serialize the aggregates.
+     * @param names the names of the observables.
+     * @param bin the number of steps in each bin.
+     * @param quantiles the quantiles to be reported.
+     */
+    nlohmann::json report(std::span<const std::string> names, uint bin, std::span<const double> quantiles) const{
+        nlohmann::json ret;
+        ret["bin"]=bin;
+        ret["observables"]=std::vector<std::string>(names.begin(),names.end());
+        ret["bins"]=nlohmann::json::array();
+        for(size_t i=0;i<bins.size();i++){
+            nlohmann::json b;
+            b["step"]=i*bin;
+            for(size_t j=0;j<observables && j<names.size();j++){
+                nlohmann::json c=bins[i][j].moments;
+                for(double q:quantiles)c["quantiles"][nlohmann::json(q).dump()]=bins[i][j].sketch.quantile(q);
+                b[names[j]]=c;
+            }
+            ret["bins"].push_back(b);
+        }
+        return ret;
+    }
+
+    /**
+     * @brief The exact state of all the bins, so that the aggregates of an instance can be stored and merged later.
+     */
+    nlohmann::json save() const{
+        nlohmann::json ret=nlohmann::json::array();
+        for(auto& b:bins){
+            nlohmann::json cells=nlohmann::json::array();
+            for(auto& c:b)cells.push_back({{"moments",c.moments.save()},{"sketch",c.sketch.save()}});
+            ret.push_back(cells);
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Replace the bins with those saved by save(), for the same observables and accuracy.
+     */
+    void restore(const nlohmann::json& j){
+        bins.assign(j.size(),std::vector<cell_t>(observables,cell_t{{},quantile_sketch(accuracy)}));
+        for(size_t i=0;i<j.size();i++){
+            for(size_t k=0;k<observables && k<j[i].size();k++){
+                bins[i][k].moments.restore(j[i][k]["moments"]);
+                bins[i][k].sketch.restore(j[i][k]["sketch"]);
+            }
+        }
+    }
+
+    private:
+        size_t                              observables;
+        double                              accuracy;
+        std::vector<std::vector<cell_t>>    bins;
+};
+
+/**
+ * @brief The quantile of the standard normal distribution, found by bisection on erfc. Only meant to be called once per configuration.
+ */
+inline double normal_quantile(double p){
+    double lo=-40, hi=40;
+    for(uint i=0;i<200;i++){
+        const double mid=(lo+hi)/2;
+        if(0.5*std::erfc(-mid/std::sqrt(2.0))<p)lo=mid;
+        else hi=mid;
+    }
+    return (lo+hi)/2;
+}
+
+/**
+ * @brief The running mean of a value measured once per instance, deciding when enough instances were sampled.
+ * It has converged once the normal confidence interval of the mean is narrower than a fraction of the mean itself, with at least a minimum number of samples.
+ * Samples can be added by any thread, with the index of their instance: they are taken in the order of the indices, those arriving early waiting for the ones before them,
+ * so that the estimate and the instance making it converge do not depend on which instances complete first.
+ * Once converged it stays so, and `converged()` is a plain atomic load to be polled by the running instances.
+ */
+struct sequential_estimate{
+    /**
+     * @param _width the width of the interval, relative to the mean.
+     * @param confidence the confidence level of the interval.
+     * @param _min_samples below this many samples it never converges.
+     */
+    sequential_estimate(double _width=0.05, double confidence=0.95, uint64_t _min_samples=10):width(_width),z(normal_quantile(0.5+confidence/2)),min_samples(_min_samples){}
+
+    /**
+     * @brief Add the sample of an instance.
+     * @param snapshot the moments including it, when it made the estimate converge.
+     * @return true only for the call making the estimate converge, which may be the one of a later instance releasing the samples held back.
+     */
+    bool add(uint64_t index, double x, running_moments& snapshot){
+        std::lock_guard<std::mutex> lock(m);
+        pending[index]=x;
+        return _advance(snapshot);
+    }
+
+    /**
+     * @brief Give up on the sample of an instance which failed, so that those after it are not held back.
+     */
+    bool skip(uint64_t index, running_moments& snapshot){
+        std::lock_guard<std::mutex> lock(m);
+        pending[index]=std::nullopt;
+        return _advance(snapshot);
+    }
+
+    /**
+     * @brief The half width of the confidence interval of the mean.
+     */
+    inline double half_width(const running_moments& r) const{return r.count==0?0:z*std::sqrt(r.variance()/r.count);}
+
+    inline bool converged() const{return _converged.load(std::memory_order_relaxed);}
+
+    running_moments current() const{
+        std::lock_guard<std::mutex> lock(m);
+        return moments;
+    }
+
+    private:
+        double                                      width;
+        double                                      z;
+        uint64_t                                    min_samples;
+        mutable std::mutex                          m;
+        running_moments                             moments;
+        uint64_t                                    next=0;     ///< The index of the next sample to be taken.
+        std::map<uint64_t,std::optional<double>>    pending;    ///< The samples arrived before some of those preceding them, empty for the skipped ones.
+        std::atomic<bool>                           _converged=false;
+
+        bool _advance(running_moments& snapshot){
+            bool ret=false;
+            for(auto it=pending.begin();it!=pending.end() && it->first==next;it=pending.erase(it),next++){
+                if(!it->second.has_value() || _converged.load(std::memory_order_relaxed))continue;
+                moments.add(*it->second);
+                if(moments.count<min_samples || 2*half_width(moments)>width*std::abs(moments.mean))continue;
+                _converged.store(true,std::memory_order_relaxed);
+                snapshot=moments;
+                ret=true;
+            }
+            return ret;
+        }
+};
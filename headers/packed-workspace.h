@@ -0,0 +1,312 @@
+#pragma once
+
+/**
+ * @file packed-workspace.h
+ * @author karurochari
+ * @brief A workspace layout storing the files of all the instances in few append-only segments.
+ * @version 0.1
+ * @date 2020-07-02
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <cstdint>
+#include <cstdio>
+#include <cerrno>
+#include <tuple>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "string-exception.h"
+
+/**
+ * @brief The segments of a packed workspace live in `%workspace/segments`.
+ * Each run of the simulator writes one pair of files for each writer lane, `%run.%lane.seg` and `%run.%lane.idx`.
+ * The segment only holds the raw bytes, while each line of the index describes one write:
+ * ```
+ * sequence <TAB> w|a <TAB> offset <TAB> length <TAB> file
+ * ```
+ * where `w` replaces the content of the file and `a` appends to it, and the file is the path it would have in the directory layout, relative to the workspace.
+ */
+struct packed_extent{
+    uint32_t    run=0;
+    uint32_t    lane=0;
+    uint64_t    seq=0;
+    bool        append=false;
+    uint64_t    offset=0;
+    uint64_t    length=0;
+};
+
+/**
+ * @brief The writing side of a packed workspace, one segment for each writer lane.
+ * Each lane is only ever used by its own writer thread, so no locking is needed.
+ */
+struct packed_store{
+    /**
+     * @param _root the workspace.
+     * @param _run the number of this run, to keep its segments apart from the previous ones.
+     * @param lanes the number of writer lanes.
+     */
+    packed_store(const std::string& _root, uint32_t _run, uint lanes):root(_root),run(_run){
+        std::filesystem::create_directories(root+"/segments");
+        for(uint i=0;i<lanes;i++){
+            lane_t l;
+            std::string base=root+"/segments/"+std::to_string(run)+"."+std::to_string(i);
+            l.seg=open((base+".seg").c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+            l.idx=open((base+".idx").c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_APPEND,0644);
+            if(l.seg<0 || l.idx<0)throw StringException("SegmentOpenException");
+            segments.push_back(l);
+        }
+    }
+
+    packed_store(const packed_store&)=delete;
+
+    ~packed_store(){
+        for(auto& l:segments){close(l.seg);close(l.idx);}
+    }
+
+    /**
+     * @brief Store a write of a lane.
+     * @param path the absolute path the file would have in the directory layout.
+     * @return 0 on success, -1 on failure.
+     */
+    int append(uint lane, const std::string& path, bool is_append, const std::string& buffer){
+        lane_t& l=segments[lane];
+
+        size_t done=0;
+        for(;done<buffer.size();){
+            ssize_t w=pwrite(l.seg,buffer.data()+done,buffer.size()-done,l.size+done);
+            if(w<0){
+                if(errno==EINTR)continue;
+                return -1;
+            }
+            done+=w;
+        }
+
+        std::string line=std::to_string(l.seq++)+"\t"+(is_append?"a":"w")+"\t"+std::to_string(l.size)+"\t"+std::to_string(buffer.size())+"\t"+_relative(path)+"\n";
+        l.size+=buffer.size();
+        if(write(l.idx,line.data(),line.size())!=(ssize_t)line.size())return -1;
+        return 0;
+    }
+
+    /**
+     * @brief The descriptors of a lane, to be synced by the writer when its durability policy requires it.
+     */
+    inline int segment_fd(uint lane) const{return segments[lane].seg;}
+    inline int index_fd(uint lane) const{return segments[lane].idx;}
+
+    private:
+        struct lane_t{
+            int         seg=-1;
+            int         idx=-1;
+            uint64_t    size=0;
+            uint64_t    seq=0;
+        };
+
+        std::string             root;
+        uint32_t                run;
+        std::vector<lane_t>     segments;
+
+        std::string _relative(const std::string& path) const{
+            if(path.compare(0,root.size()+1,root+"/")==0)return path.substr(root.size()+1);
+            return path;
+        }
+};
+
+/**
+ * @brief The reading side of a packed workspace.
+ * It loads all the indices, and resolves the content each file would have in the directory layout.
+ * ```
+ * packed_workspace ws("/tmp/h3");
+ * std::string status=ws.read("tasks/a/0/status");
+ * ```
+ */
+struct packed_workspace{
+    packed_workspace(const packed_workspace&)=delete;
+
+    ~packed_workspace(){_close();}
+
+    packed_workspace(const std::string& _root):root(_root){
+        if(!std::filesystem::exists(root+"/segments"))return;
+        for(auto& e:std::filesystem::directory_iterator(root+"/segments")){
+            if(e.path().extension()!=".idx")continue;
+            uint32_t r,l;
+            if(sscanf(e.path().filename().c_str(),"%u.%u.idx",&r,&l)!=2)continue;
+            if(r>=next)next=r+1;
+            _load(e.path(),r,l);
+        }
+        _prune();
+    }
+
+    /**
+     * @brief The number to be used by the next run.
+     */
+    inline uint32_t next_run() const{return next;}
+
+    inline bool exists(const std::string& file) const{return files.count(file)!=0;}
+
+    /**
+     * @brief The list of all the files stored.
+     */
+    std::vector<std::string> list() const{
+        std::vector<std::string> ret;
+        for(auto& [k,v]:files)ret.push_back(k);
+        return ret;
+    }
+
+    /**
+     * @brief The size the file would have in the directory layout.
+     */
+    uint64_t size(const std::string& file) const{
+        auto it=files.find(file);
+        if(it==files.end())return 0;
+        uint64_t ret=0;
+        for(auto& [k,e]:it->second)ret+=e.length;
+        return ret;
+    }
+
+    /**
+     * @brief The content the file would have in the directory layout.
+     */
+    std::string read(const std::string& file) const{
+        auto it=files.find(file);
+        if(it==files.end())throw StringException("PackedFileNotFoundException");
+        std::string ret;
+        ret.reserve(size(file));
+        for(auto& [k,e]:it->second){
+            int fd=_open(e.run,e.lane);
+            size_t base=ret.size();
+            ret.resize(base+e.length);
+            ssize_t r=pread(fd,ret.data()+base,e.length,e.offset);
+            if(r!=(ssize_t)e.length)throw StringException("SegmentReadException");
+        }
+        return ret;
+    }
+
+    /**
+     * @brief Rewrite all the segments as a single one, where each file is a single extent.
+     * The compacted segment and its index are written as a new run, and forced on disk with their directory, before the older ones are removed, so that an interruption never loses data.
+     */
+    void compact(){
+        const uint32_t r=next;
+        {
+            int seg=open(_segment(r,0).c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+            if(seg<0)throw StringException("SegmentOpenException");
+            std::string idx;
+            uint64_t offset=0, seq=0;
+            for(auto& [k,v]:files){
+                std::string content=read(k);
+                if(!_write_all(seg,content)){close(seg);throw StringException("SegmentWriteException");}
+                idx+=std::to_string(seq++)+"\tw\t"+std::to_string(offset)+"\t"+std::to_string(content.size())+"\t"+k+"\n";
+                offset+=content.size();
+            }
+            fsync(seg);
+            close(seg);
+
+            int fd=open(_index(r,0).c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+            if(fd<0)throw StringException("SegmentOpenException");
+            if(!_write_all(fd,idx)){close(fd);throw StringException("SegmentWriteException");}
+            fsync(fd);
+            close(fd);
+
+            //The new run must be there after a crash before the old ones can go.
+            fd=open((root+"/segments").c_str(),O_RDONLY|O_DIRECTORY);
+            if(fd<0)throw StringException("SegmentOpenException");
+            fsync(fd);
+            close(fd);
+        }
+
+        std::vector<std::filesystem::path> old;
+        for(auto& e:std::filesystem::directory_iterator(root+"/segments")){
+            uint32_t er,el;
+            if(sscanf(e.path().filename().c_str(),"%u.%u.",&er,&el)==2 && er!=r)old.push_back(e.path());
+        }
+        _close();
+        for(auto& p:old)std::filesystem::remove(p);
+
+        files.clear();
+        _load(_index(r,0),r,0);
+        _prune();
+        next=r+1;
+    }
+
+    private:
+        typedef std::tuple<uint32_t,uint32_t,uint64_t> order_t;    ///< Run, lane and sequence.
+
+        std::string                                         root;
+        uint32_t                                            next=0;
+        std::map<std::string,std::map<order_t,packed_extent>> files;
+        mutable std::map<std::pair<uint32_t,uint32_t>,int> descriptors;    ///< The segments opened so far for reading.
+
+        static bool _write_all(int fd, const std::string& buffer){
+            for(size_t done=0;done<buffer.size();){
+                ssize_t w=::write(fd,buffer.data()+done,buffer.size()-done);
+                if(w<0){
+                    if(errno==EINTR)continue;
+                    return false;
+                }
+                done+=w;
+            }
+            return true;
+        }
+
+        int _open(uint32_t r, uint32_t l) const{
+            auto it=descriptors.find({r,l});
+            if(it!=descriptors.end())return it->second;
+            int fd=open(_segment(r,l).c_str(),O_RDONLY);
+            if(fd<0)throw StringException("SegmentOpenException");
+            descriptors[{r,l}]=fd;
+            return fd;
+        }
+
+        void _close(){
+            for(auto& [k,fd]:descriptors)close(fd);
+            descriptors.clear();
+        }
+
+        std::string _segment(uint32_t r, uint32_t l) const{
+            return root+"/segments/"+std::to_string(r)+"."+std::to_string(l)+".seg";
+        }
+
+        std::string _index(uint32_t r, uint32_t l) const{
+            return root+"/segments/"+std::to_string(r)+"."+std::to_string(l)+".idx";
+        }
+
+        void _load(const std::filesystem::path& idx, uint32_t r, uint32_t l){
+            std::ifstream in(idx);
+            for(std::string line;std::getline(in,line);){
+                std::istringstream fields(line);
+                packed_extent e;
+                e.run=r;
+                e.lane=l;
+                std::string op, name;
+                if(!(fields>>e.seq>>op>>e.offset>>e.length))continue;
+                fields.get();
+                std::getline(fields,name);
+                e.append=(op=="a");
+                files[name][{r,l,e.seq}]=e;
+            }
+        }
+
+        /**
+         * @brief Drop the extents preceding the last replacing write of each file, as they do not contribute to its content.
+         * Indices can be loaded in any order, so this is only done once all of them are there.
+         */
+        void _prune(){
+            for(auto& [k,extents]:files){
+                auto last=extents.end();
+                for(auto it=extents.begin();it!=extents.end();it++){
+                    if(!it->second.append)last=it;
+                }
+                if(last!=extents.end())extents.erase(extents.begin(),last);
+            }
+        }
+};
@@ -0,0 +1,241 @@
+#pragma once
+
+/**
+ * @file parameter-sweep.h
+ * @author karurochari
+ * @brief The points of a parameter sweep, computed one at a time from their index.
+ * @version 0.1
+ * @date 2020-07-24
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <charconv>
+#include <iostream>
+
+#include <nlohmann/json.hpp>
+
+#include "string-exception.h"
+#include "hashing.h"
+#include "counter-rng.h"
+
+/**
+ * @brief How the points of a sweep are placed.
+ * - `grid` takes every combination of the values of the axes, the last axis changing fastest.
+ * - `latin-hypercube` takes a given number of points, so that each axis has exactly one point in each of as many strata.
+ */
+enum class sweep_mode_t{grid, latin_hypercube};
+
+inline bool sweep_mode_from_string(const std::string& s, sweep_mode_t& m){
+    if(s=="grid")m=sweep_mode_t::grid;
+    else if(s=="latin-hypercube")m=sweep_mode_t::latin_hypercube;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief A sweep over some axes, each one setting its value at a JSON pointer of the configuration of a point.
+ * An axis either lists its `values`, which can be any JSON, or spans a numeric `range` [min,max], cut in `steps` values in a grid.
+ * Nothing is stored per point: the values of any point are computed from its index, so sweeps of any size take the same memory.
+ */
+struct parameter_sweep{
+    struct axis_t{
+        nlohmann::json::json_pointer    pointer;
+        std::vector<nlohmann::json>     values;         ///< Empty for a range.
+        double                          min=0;
+        double                          max=0;
+        uint64_t                        steps=0;        ///< The values of a range in a grid.
+        bool                            integer=false;  ///< Are the values of a range rounded?
+
+        inline uint64_t size() const{return values.empty()?steps:values.size();}
+    };
+
+    parameter_sweep()=default;
+
+    /**
+     * @param config the `sweep` object.
+     * @param _seed the seed of the latin hypercube, when the sweep has none.
+     * @param err where the problems of the configuration are reported, before throwing.
+     */
+    parameter_sweep(const nlohmann::json& config, uint64_t _seed, std::ostream& err):seed(_seed){
+        auto fail=[&](const std::string& msg){
+            err<<"Error: "<<msg<<". An exception will be thrown.\n";
+            throw StringException("MisformedSweepException");
+        };
+
+        auto it=config.find("mode");
+        if(it!=config.end() && it->is_string()){
+            if(!sweep_mode_from_string(*it,mode))fail("the sweep mode ["+it->get<std::string>()+"] is not supported");
+        }
+        else if(it!=config.end())fail("the field [sweep/mode] must be a string");
+
+        it=config.find("seed");
+        if(it!=config.end() && it->is_number_unsigned())seed=*it;
+        else if(it!=config.end())fail("the field [sweep/seed] must be an unsigned integer");
+
+        it=config.find("axes");
+        if(it==config.end() || !it->is_array() || it->empty())fail("the field [sweep/axes] must be a non-empty array");
+        for(auto& a:*it){
+            axis_t axis;
+            if(!a.is_object() || !a.contains("pointer") || !a["pointer"].is_string())fail("each axis of a sweep needs a [pointer]");
+            try{
+                axis.pointer=nlohmann::json::json_pointer(a["pointer"].get<std::string>());
+            }
+            catch(std::exception& e){
+                fail("the pointer ["+a["pointer"].get<std::string>()+"] is not valid");
+            }
+            if(axis.pointer.empty())fail("the pointer of an axis cannot be the whole batch");
+
+            if(a.contains("values")){
+                if(!a["values"].is_array() || a["values"].empty())fail("the values of an axis must be a non-empty array");
+                for(auto& v:a["values"])axis.values.push_back(v);
+            }
+            else if(a.contains("range")){
+                auto& r=a["range"];
+                if(!r.is_array() || r.size()!=2 || !r[0].is_number() || !r[1].is_number())fail("the range of an axis must be [min,max]");
+                axis.min=r[0];
+                axis.max=r[1];
+                axis.integer=a.value("integer",false);
+                if(a.contains("steps")){
+                    if(!a["steps"].is_number_unsigned() || a["steps"]==0)fail("the steps of an axis must be a positive integer");
+                    axis.steps=a["steps"];
+                }
+                else if(mode==sweep_mode_t::grid)fail("a range in a grid needs its [steps]");
+            }
+            else fail("each axis of a sweep needs either [values] or a [range]");
+            axes.push_back(std::move(axis));
+        }
+
+        if(mode==sweep_mode_t::grid){
+            points=1;
+            for(auto& a:axes){
+                if(points>std::numeric_limits<uint32_t>::max()/a.size())fail("the grid of the sweep has too many points");
+                points*=a.size();
+            }
+        }
+        else{
+            it=config.find("points");
+            if(it!=config.end() && it->is_number_unsigned() && *it!=0 && *it<=std::numeric_limits<uint32_t>::max())points=*it;
+            else fail("a latin hypercube needs its number of [points]");
+        }
+    }
+
+    inline uint64_t size() const{return points;}
+
+    /**
+     * @brief The value of each axis at a point, in the order of the axes.
+     */
+    std::vector<nlohmann::json> values(uint64_t point) const{
+        std::vector<nlohmann::json> ret(axes.size());
+        if(mode==sweep_mode_t::grid){
+            for(size_t a=axes.size();a-->0;){
+                const uint64_t n=axes[a].size();
+                ret[a]=_value(axes[a],point%n,n,-1);
+                point/=n;
+            }
+        }
+        else{
+            for(size_t a=0;a<axes.size();a++){
+                const uint64_t stratum=_permute(point,a);
+                //Values within the stratum of a range are random, those of a list are taken at its start.
+                philox_rng rng(mix64(seed^0x5377656570ull),a,2*point);
+                ret[a]=_value(axes[a],stratum,points,rng.uniform());
+            }
+        }
+        return ret;
+    }
+
+    /**
+     * @brief The value at a point of the axis with a given pointer, null if there is none.
+     */
+    nlohmann::json value(uint64_t point, const nlohmann::json::json_pointer& pointer) const{
+        for(size_t a=0;a<axes.size();a++){
+            if(axes[a].pointer==pointer)return std::move(values(point)[a]);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Set the value of each axis at its pointer in a configuration, already merged with its defaults.
+     * Members of objects are added when missing, while elements of arrays must already be there: a merge-patch would replace the whole array instead.
+     * Throws if a pointer goes through a value which is neither an object nor an array, or past the end of an array.
+     */
+    void apply(uint64_t point, nlohmann::json& config) const{
+        auto v=values(point);
+        for(size_t a=0;a<axes.size();a++)_set(config,axes[a].pointer,std::move(v[a]));
+    }
+
+    private:
+        sweep_mode_t        mode=sweep_mode_t::grid;
+        std::vector<axis_t> axes;
+        uint64_t            points=0;
+        uint64_t            seed=0;
+
+        static void _set(nlohmann::json& config, const nlohmann::json::json_pointer& pointer, nlohmann::json value){
+            std::vector<std::string> tokens;
+            for(auto p=pointer;!p.empty();p.pop_back())tokens.push_back(p.back());
+
+            nlohmann::json* at=&config;
+            for(size_t i=tokens.size();i-->0;){
+                const std::string& t=tokens[i];
+                if(at->is_array()){
+                    size_t index=0;
+                    auto [end,ec]=std::from_chars(t.data(),t.data()+t.size(),index);
+                    if(ec!=std::errc() || end!=t.data()+t.size() || index>=at->size())throw StringException("SweepPointerException for ["+pointer.to_string()+"], past the end of an array");
+                    at=&(*at)[index];
+                }
+                else{
+                    if(at->is_null())*at=nlohmann::json::object();
+                    if(!at->is_object())throw StringException("SweepPointerException for ["+pointer.to_string()+"], through a value which is neither an object nor an array");
+                    at=&(*at)[t];
+                }
+            }
+            *at=std::move(value);
+        }
+
+        /**
+         * @brief The value of an axis in the i-th of n strata, at a fraction u of it. A negative u takes the i-th of n evenly spaced values instead, as in a grid.
+         */
+        static nlohmann::json _value(const axis_t& axis, uint64_t i, uint64_t n, double u){
+            if(!axis.values.empty())return axis.values[i*axis.values.size()/n];
+            double v;
+            if(u<0)v=(n==1)?axis.min:axis.min+(axis.max-axis.min)*i/(n-1);
+            else v=axis.min+(axis.max-axis.min)*(i+u)/n;
+            if(axis.integer){
+                //Counts like the instances are only accepted as unsigned integers.
+                const int64_t r=std::llround(v);
+                if(r>=0)return (uint64_t)r;
+                return r;
+            }
+            return v;
+        }
+
+        /**
+         * @brief The stratum of a point along an axis: a pseudo-random permutation of [0,points), different for each axis.
+         * It is a small Feistel network over the smallest even power of two covering the points, walking the cycle until it lands inside, so no table is kept.
+         */
+        uint64_t _permute(uint64_t x, uint64_t axis) const{
+            uint bits=2;
+            for(;(1ull<<bits)<points;bits+=2);
+            const uint half=bits/2;
+            const uint64_t mask=(1ull<<half)-1;
+            const uint64_t key=mix64(seed^mix64(axis+1));
+            do{
+                uint64_t l=x>>half, r=x&mask;
+                for(uint round=0;round<4;round++){
+                    const uint64_t f=mix64(key^(r*4+round))&mask;
+                    const uint64_t t=r;
+                    r=l^f;
+                    l=t;
+                }
+                x=(l<<half)|r;
+            }while(x>=points);
+            return x;
+        }
+};
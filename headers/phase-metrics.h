@@ -0,0 +1,325 @@
+#pragma once
+
+/**
+ * @file phase-metrics.h
+ * @author karurochari
+ * @brief Latency histograms and counters for the phases of the hot path, compiled in only with SSAGI_METRICS.
+ * @version 0.1
+ * @date 2020-07-18
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+
+#include <nlohmann/json.hpp>
+
+/**
+ * @brief The phases timed by the runner.
+ */
+enum class phase_t{
+    task,           ///< A whole task, as run by a worker of the queue.
+    idle,           ///< A worker of the queue looking for its next task.
+    model,          ///< A step of the model, or of all the lanes of a group.
+    end_condition,  ///< An evaluation of the end condition.
+    serialize,      ///< Writing the states of a checkpoint as JSON.
+    submit,         ///< Handing the buffers of a checkpoint to the writer, waiting for room in its queue included.
+    backup,         ///< Submitting the backup copies.
+    callback,       ///< Running a callback, in the simulation thread or in the dispatcher.
+    open,           ///< Opening a file in a writer thread.
+    write,          ///< Writing a buffer in a writer thread.
+    fsync,          ///< Forcing a file on the storage device.
+    size
+};
+
+/**
+ * @brief The events counted by the runner.
+ */
+enum class counter_t{
+    bytes_written,
+    files_opened,
+    checkpoints,
+    size
+};
+
+inline const char* to_string(phase_t p){
+    static const char* names[]={"task","idle","model","end_condition","serialize","submit","backup","callback","open","write","fsync"};
+    return names[(uint)p];
+}
+
+inline const char* to_string(counter_t c){
+    static const char* names[]={"bytes_written","files_opened","checkpoints"};
+    return names[(uint)c];
+}
+
+/**
+ * @brief A log-linear histogram of nanoseconds, as in HDR histograms: each power of two is split in 16 buckets, so any value is known within about 6%.
+ * It is written by a single thread without locking, and can be read by any other at the same time.
+ */
+struct latency_histogram{
+    static constexpr uint   sub_bits=4;
+    static constexpr uint   sub=1u<<sub_bits;
+    static constexpr uint   buckets=(64-sub_bits+1)*sub;
+
+    static constexpr uint index(uint64_t v){
+        if(v<sub)return v;
+        const uint e=63-__builtin_clzll(v);
+        return (e-sub_bits+1)*sub+(uint)((v>>(e-sub_bits))&(sub-1));
+    }
+
+    /**
+     * @brief The smallest value of a bucket.
+     */
+    static constexpr uint64_t lower(uint i){
+        if(i<sub)return i;
+        const uint e=i/sub+sub_bits-1;
+        return (uint64_t)(sub+i%sub)<<(e-sub_bits);
+    }
+
+    /**
+     * @brief The first value past a bucket.
+     */
+    static constexpr uint64_t upper(uint i){
+        if(i<sub)return i+1;
+        const uint e=i/sub+sub_bits-1;
+        return lower(i)+(1ull<<(e-sub_bits));
+    }
+
+    /**
+     * @brief Only called by the owning thread.
+     */
+    inline void add(uint64_t ns){
+        _bump(counts[index(ns)],1);
+        _bump(_count,1);
+        _bump(_sum,ns);
+        if(ns<_min.load(std::memory_order_relaxed))_min.store(ns,std::memory_order_relaxed);
+        if(ns>_max.load(std::memory_order_relaxed))_max.store(ns,std::memory_order_relaxed);
+    }
+
+    void merge(const latency_histogram& o){
+        if(o.count()==0)return;
+        for(uint i=0;i<buckets;i++)_bump(counts[i],o.counts[i].load(std::memory_order_relaxed));
+        _bump(_count,o.count());
+        _bump(_sum,o.sum());
+        _min.store(std::min(_min.load(std::memory_order_relaxed),o._min.load(std::memory_order_relaxed)),std::memory_order_relaxed);
+        _max.store(std::max(max(),o.max()),std::memory_order_relaxed);
+    }
+
+    void reset(){
+        for(auto& c:counts)c.store(0,std::memory_order_relaxed);
+        _count.store(0,std::memory_order_relaxed);
+        _sum.store(0,std::memory_order_relaxed);
+        _min.store(std::numeric_limits<uint64_t>::max(),std::memory_order_relaxed);
+        _max.store(0,std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief The value below which a fraction q of the samples lie, as the middle of its bucket.
+     */
+    uint64_t quantile(double q) const{
+        const uint64_t n=count();
+        if(n==0)return 0;
+        const uint64_t rank=std::max<uint64_t>(1,(uint64_t)(q*n+0.5));
+        uint64_t seen=0;
+        for(uint i=0;i<buckets;i++){
+            seen+=bucket(i);
+            if(seen>=rank)return std::clamp<uint64_t>(lower(i)+(upper(i)-lower(i))/2,min(),max());
+        }
+        return max();
+    }
+
+    inline uint64_t bucket(uint i) const{return counts[i].load(std::memory_order_relaxed);}
+    inline uint64_t count() const{return _count.load(std::memory_order_relaxed);}
+    inline uint64_t sum() const{return _sum.load(std::memory_order_relaxed);}
+    inline uint64_t min() const{return count()==0?0:_min.load(std::memory_order_relaxed);}
+    inline uint64_t max() const{return _max.load(std::memory_order_relaxed);}
+
+    private:
+        std::array<std::atomic<uint64_t>,buckets>   counts{};
+        std::atomic<uint64_t>                       _count=0;
+        std::atomic<uint64_t>                       _sum=0;
+        std::atomic<uint64_t>                       _min=std::numeric_limits<uint64_t>::max();
+        std::atomic<uint64_t>                       _max=0;
+
+        //A single writer does not need a locked increment.
+        static inline void _bump(std::atomic<uint64_t>& c, uint64_t v){c.store(c.load(std::memory_order_relaxed)+v,std::memory_order_relaxed);}
+};
+
+/**
+ * @brief The metrics of the process: each thread records in its own shard, and the shards are only merged when a report is written.
+ * Shards outlive their threads, so the writer threads and the pool of a queue can be gone by then.
+ * The shard of a thread which exited is handed to the next new thread, which keeps adding to it: the shards are as many as the threads alive at the same time, not as all those ever started.
+ * Without SSAGI_METRICS every call is empty and the shards are never created.
+ */
+struct phase_metrics{
+    #ifdef SSAGI_METRICS
+    static constexpr bool enabled=true;
+    #else
+    static constexpr bool enabled=false;
+    #endif
+
+    typedef std::chrono::steady_clock clock_t;
+
+    static inline void add(phase_t p, uint64_t ns){
+        if constexpr(enabled)_local().phases[(uint)p].add(ns);
+    }
+
+    static inline void count(counter_t c, uint64_t n=1){
+        if constexpr(enabled){
+            auto& v=_local().counters[(uint)c];
+            v.store(v.load(std::memory_order_relaxed)+n,std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Forget what was recorded so far, at the beginning of a run or in a freshly forked worker.
+     */
+    static void reset(){
+        if constexpr(enabled){
+            std::lock_guard<std::mutex> lock(m);
+            for(auto& s:shards){
+                for(auto& h:s->phases)h.reset();
+                for(auto& c:s->counters)c.store(0,std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * @brief The merged metrics as JSON, with the main quantiles of each phase in nanoseconds.
+     */
+    static nlohmann::json report(){
+        auto merged=_merged();
+        const shard_t& total=*merged;
+        nlohmann::json ret;
+        ret["phases"]=nlohmann::json::object();
+        for(uint i=0;i<(uint)phase_t::size;i++){
+            const latency_histogram& h=total.phases[i];
+            if(h.count()==0)continue;
+            auto& j=ret["phases"][to_string((phase_t)i)];
+            j["count"]=h.count();
+            j["sum-ns"]=h.sum();
+            j["mean-ns"]=(double)h.sum()/h.count();
+            j["min-ns"]=h.min();
+            j["p50-ns"]=h.quantile(0.5);
+            j["p90-ns"]=h.quantile(0.9);
+            j["p99-ns"]=h.quantile(0.99);
+            j["p999-ns"]=h.quantile(0.999);
+            j["max-ns"]=h.max();
+        }
+        for(uint i=0;i<(uint)counter_t::size;i++)ret["counters"][to_string((counter_t)i)]=total.counters[i].load(std::memory_order_relaxed);
+        return ret;
+    }
+
+    /**
+     * @brief The merged metrics in the Prometheus text format. Only the buckets holding samples are listed, with their bounds in seconds.
+     */
+    static std::string prometheus(){
+        auto merged=_merged();
+        const shard_t& total=*merged;
+        std::string ret;
+        char buf[64];
+        auto seconds=[&](uint64_t ns){snprintf(buf,sizeof(buf),"%.9g",ns*1e-9);return std::string(buf);};
+
+        ret+="# HELP ssagi_phase_seconds Time spent in each phase of the simulation.\n";
+        ret+="# TYPE ssagi_phase_seconds histogram\n";
+        for(uint i=0;i<(uint)phase_t::size;i++){
+            const latency_histogram& h=total.phases[i];
+            if(h.count()==0)continue;
+            const std::string label=std::string("phase=\"")+to_string((phase_t)i)+"\"";
+            uint64_t seen=0;
+            for(uint b=0;b<latency_histogram::buckets;b++){
+                if(h.bucket(b)==0)continue;
+                seen+=h.bucket(b);
+                ret+="ssagi_phase_seconds_bucket{"+label+",le=\""+seconds(latency_histogram::upper(b))+"\"} "+std::to_string(seen)+"\n";
+            }
+            ret+="ssagi_phase_seconds_bucket{"+label+",le=\"+Inf\"} "+std::to_string(h.count())+"\n";
+            ret+="ssagi_phase_seconds_sum{"+label+"} "+seconds(h.sum())+"\n";
+            ret+="ssagi_phase_seconds_count{"+label+"} "+std::to_string(h.count())+"\n";
+        }
+        for(uint i=0;i<(uint)counter_t::size;i++){
+            const std::string name=std::string("ssagi_")+to_string((counter_t)i)+"_total";
+            ret+="# TYPE "+name+" counter\n";
+            ret+=name+" "+std::to_string(total.counters[i].load(std::memory_order_relaxed))+"\n";
+        }
+        return ret;
+    }
+
+    private:
+        struct shard_t{
+            std::array<latency_histogram,(uint)phase_t::size>       phases;
+            std::array<std::atomic<uint64_t>,(uint)counter_t::size> counters{};
+        };
+
+        /**
+         * @brief The shard of a thread, given back when the thread exits.
+         */
+        struct owner_t{
+            shard_t* s=nullptr;
+
+            ~owner_t(){
+                if(s==nullptr)return;
+                std::lock_guard<std::mutex> lock(m);
+                spare.push_back(s);
+            }
+        };
+
+        static inline std::mutex                            m;
+        static inline std::vector<std::unique_ptr<shard_t>> shards;
+        static inline std::vector<shard_t*>                 spare;  ///< The shards of the threads which exited.
+
+        static shard_t& _local(){
+            thread_local owner_t owner;
+            if(owner.s==nullptr){
+                std::lock_guard<std::mutex> lock(m);
+                if(!spare.empty()){
+                    owner.s=spare.back();
+                    spare.pop_back();
+                }
+                else{
+                    shards.emplace_back(std::make_unique<shard_t>());
+                    owner.s=shards.back().get();
+                }
+            }
+            return *owner.s;
+        }
+
+        static std::unique_ptr<shard_t> _merged(){
+            auto total=std::make_unique<shard_t>();
+            std::lock_guard<std::mutex> lock(m);
+            for(auto& s:shards){
+                for(uint i=0;i<(uint)phase_t::size;i++)total->phases[i].merge(s->phases[i]);
+                for(uint i=0;i<(uint)counter_t::size;i++)total->counters[i].fetch_add(s->counters[i].load(std::memory_order_relaxed),std::memory_order_relaxed);
+            }
+            return total;
+        }
+};
+
+/**
+ * @brief Time the enclosing scope as a phase. Without SSAGI_METRICS it does not even read the clock.
+ */
+struct phase_scope{
+    inline phase_scope(phase_t _p):p(_p){
+        if constexpr(phase_metrics::enabled)start=phase_metrics::clock_t::now();
+    }
+
+    inline ~phase_scope(){
+        if constexpr(phase_metrics::enabled)phase_metrics::add(p,std::chrono::duration_cast<std::chrono::nanoseconds>(phase_metrics::clock_t::now()-start).count());
+    }
+
+    phase_scope(const phase_scope&)=delete;
+
+    private:
+        phase_t                             p;
+        phase_metrics::clock_t::time_point  start;
+};
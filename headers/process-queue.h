@@ -0,0 +1,334 @@
+#pragma once
+
+/**
+ * @file process-queue.h
+ * @author karurochari
+ * @brief A pool of pre-forked worker processes, so that a crashing task does not take down the others.
+ * @version 0.1
+ * @date 2020-07-14
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <ctime>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "string-exception.h"
+#include "workers-queue.h"
+
+/**
+ * @brief A unit of work as it travels to a worker process: plain integers, no pointers.
+ */
+struct process_job_t{
+    uint32_t    batch=0;        ///< The index of the batch.
+    uint32_t    first=0;        ///< The first instance.
+    uint32_t    count=1;        ///< How many instances, starting from first.
+    uint32_t    attempt=0;      ///< How many times it was already started by a worker which then crashed.
+};
+
+/**
+ * @brief Drive a fixed pool of worker processes, forked once, through a ring in shared memory.
+ * The parent feeds the ring from the generator and collects the results, while each worker takes one job at a time.
+ * The ring is guarded by a robust mutex, so a worker dying while holding it does not block the others, and each worker records there the job it is running:
+ * when it crashes, the job is rescheduled up to a maximum number of attempts and the worker is forked again.
+ * Semaphores are only used to wake up the other side, the state of the ring is always checked under the mutex.
+ * @tparam T the generator type. Besides `begin()` and `end()`, whose iterators expose `key()` returning a process_job_t, it must provide
+ * - `int run(const process_job_t&)` to perform a job in a worker.
+ * - `void worker_begin(uint)` and `void worker_end()` called by each worker process when it starts and before it exits.
+ */
+template <typename T>
+struct process_queue{
+    /**
+     * @param l the number of worker processes.
+     * @param retries how many times a job whose worker crashed is rescheduled.
+     * @param c the number of jobs queued for each worker.
+     */
+    process_queue(uint l=1, uint retries=2, uint c=2):max_queue(l==0?1:l),max_retries(retries),capacity(max_queue*(c==0?1:c)){}
+
+    process_queue(const process_queue&)=delete;
+
+    ~process_queue(){_unmap();}
+
+    /**
+     * @brief Run all the jobs of the generator in the worker processes.
+     * @return the number of jobs failed, crashed ones included.
+     */
+    int operator()(T& cc, bool verbose=true, std::ostream& out=std::cout, std::ostream& err=std::cerr){
+        _map();
+        uint bad_counter=0;
+        auto ii=cc.begin();
+        const auto ee=cc.end();
+
+        std::deque<entry_t> retry;
+        uint64_t outstanding=0;
+        uint idle_deaths=0;
+
+        //Whatever is buffered would be written again by every child.
+        out.flush();
+        err.flush();
+        fflush(nullptr);
+        pids.assign(max_queue,-1);
+        for(uint i=0;i<max_queue;i++)_spawn(cc,i);
+
+        for(;;){
+            uint posted=0;
+            _lock();
+            for(;shared->job_tail-shared->job_head<capacity && (!retry.empty() || ii!=ee);){
+                entry_t e;
+                if(!retry.empty()){e=retry.front();retry.pop_front();}
+                else{e.job=ii.key();e.id=next_id++;++ii;}
+                jobs[shared->job_tail%capacity]=e;
+                shared->job_tail++;
+                outstanding++;
+                posted++;
+                if(verbose)out<<"Started   ["<<e.id<<"]\n";
+            }
+            for(;shared->result_head!=shared->result_tail;shared->result_head++){
+                const result_t& r=results[shared->result_head%_result_capacity()];
+                if(verbose){
+                    if(r.exception)err<<"Exception in task ["<<r.entry.id<<"]\n";
+                    else out<<"Completed ["<<r.entry.id<<"]\tin "<<r.duration<<". Returned ["<<r.ret_val<<"]\n";
+                }
+                if(r.exception || r.ret_val!=0)bad_counter++;
+                outstanding--;
+            }
+            _unlock();
+            for(uint i=0;i<posted;i++)sem_post(&shared->jobs_ready);
+
+            if(outstanding==0 && retry.empty() && !(ii!=ee))break;
+
+            int status;
+            for(pid_t pid;(pid=waitpid(-1,&status,WNOHANG))>0;){
+                uint w=0;
+                for(;w<max_queue && pids[w]!=pid;w++);
+                if(w==max_queue)continue;
+
+                _lock();
+                worker_slot_t& s=slots[w];
+                const bool busy=s.busy;
+                const entry_t e=s.entry;
+                s.busy=false;
+                _unlock();
+
+                if(busy){
+                    idle_deaths=0;
+                    outstanding--;
+                    err<<"Worker ["<<w<<"] crashed ("<<_describe(status)<<") running task ["<<e.id<<"]";
+                    if(e.job.attempt<max_retries){
+                        entry_t again=e;
+                        again.job.attempt++;
+                        retry.push_back(again);
+                        err<<", it will be resumed from its last checkpoint.\n";
+                    }
+                    else{
+                        bad_counter++;
+                        err<<", it will not be attempted again.\n";
+                    }
+                }
+                else if(++idle_deaths>4*max_queue){
+                    _shutdown();
+                    err<<"Error: the worker processes keep exiting without running any task. An exception will be thrown.\n";
+                    throw StringException("WorkerSpawnException");
+                }
+
+                out.flush();
+                err.flush();
+                fflush(nullptr);
+                _spawn(cc,w);
+                //Its wake-up might have been consumed by the dead worker.
+                sem_post(&shared->jobs_ready);
+            }
+
+            timespec ts;
+            clock_gettime(CLOCK_REALTIME,&ts);
+            ts.tv_nsec+=20*1000*1000;
+            if(ts.tv_nsec>=1000*1000*1000){ts.tv_sec++;ts.tv_nsec-=1000*1000*1000;}
+            sem_timedwait(&shared->results_ready,&ts);
+        }
+
+        _shutdown();
+
+        if(verbose && bad_counter!=0){
+            out<<"Queue completed. ["<<bad_counter<<"] tasks failed.";
+        }
+        return bad_counter;
+    }
+
+    private:
+        struct entry_t{
+            process_job_t   job;
+            uint            id=0;           ///< The id used in the report.
+        };
+
+        struct worker_slot_t{
+            bool            busy=false;
+            entry_t         entry;
+        };
+
+        struct result_t{
+            entry_t         entry;
+            int             ret_val=0;
+            uint            duration=0;
+            bool            exception=false;
+        };
+
+        struct shared_t{
+            pthread_mutex_t m;
+            sem_t           jobs_ready;
+            sem_t           results_ready;
+            uint64_t        job_head=0;
+            uint64_t        job_tail=0;
+            uint64_t        result_head=0;
+            uint64_t        result_tail=0;
+            bool            closing=false;
+        };
+
+        uint                max_queue;
+        uint                max_retries;
+        uint                capacity;
+        uint                next_id=0;
+        std::vector<pid_t>  pids;
+
+        void*               region=nullptr;
+        size_t              region_size=0;
+        shared_t*           shared=nullptr;
+        entry_t*            jobs=nullptr;
+        result_t*           results=nullptr;
+        worker_slot_t*      slots=nullptr;
+
+        /**
+         * @brief Results never outnumber the jobs queued plus those running, so the workers never wait to publish one.
+         */
+        inline uint64_t _result_capacity() const{return capacity+max_queue;}
+
+        void _map(){
+            _unmap();
+            region_size=sizeof(shared_t)+capacity*sizeof(entry_t)+_result_capacity()*sizeof(result_t)+max_queue*sizeof(worker_slot_t);
+            region=mmap(nullptr,region_size,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_ANONYMOUS,-1,0);
+            if(region==MAP_FAILED){region=nullptr;throw StringException("SharedMemoryException");}
+
+            shared=new(region) shared_t();
+            jobs=(entry_t*)((char*)region+sizeof(shared_t));
+            results=(result_t*)(jobs+capacity);
+            slots=(worker_slot_t*)(results+_result_capacity());
+            for(uint i=0;i<capacity;i++)new(jobs+i) entry_t();
+            for(uint i=0;i<_result_capacity();i++)new(results+i) result_t();
+            for(uint i=0;i<max_queue;i++)new(slots+i) worker_slot_t();
+
+            pthread_mutexattr_t attr;
+            pthread_mutexattr_init(&attr);
+            pthread_mutexattr_setpshared(&attr,PTHREAD_PROCESS_SHARED);
+            pthread_mutexattr_setrobust(&attr,PTHREAD_MUTEX_ROBUST);
+            pthread_mutex_init(&shared->m,&attr);
+            pthread_mutexattr_destroy(&attr);
+            sem_init(&shared->jobs_ready,1,0);
+            sem_init(&shared->results_ready,1,0);
+        }
+
+        void _unmap(){
+            if(region==nullptr)return;
+            pthread_mutex_destroy(&shared->m);
+            sem_destroy(&shared->jobs_ready);
+            sem_destroy(&shared->results_ready);
+            munmap(region,region_size);
+            region=nullptr;
+        }
+
+        void _lock(){
+            //A worker died holding the lock. The sections it guards are short enough to leave the ring consistent.
+            if(pthread_mutex_lock(&shared->m)==EOWNERDEAD)pthread_mutex_consistent(&shared->m);
+        }
+
+        inline void _unlock(){pthread_mutex_unlock(&shared->m);}
+
+        void _spawn(T& cc, uint w){
+            pid_t pid=fork();
+            if(pid<0)throw StringException("ForkException");
+            if(pid>0){pids[w]=pid;return;}
+
+            //The worker process, it never returns.
+            int code=0;
+            try{
+                this_worker=w;
+                cc.worker_begin(w);
+                _serve(cc,w);
+                cc.worker_end();
+            }
+            catch(...){
+                code=1;
+            }
+            fflush(nullptr);
+            _exit(code);
+        }
+
+        void _serve(T& cc, uint w){
+            for(;;){
+                if(sem_wait(&shared->jobs_ready)!=0)continue;
+
+                _lock();
+                if(shared->job_head==shared->job_tail){
+                    const bool closing=shared->closing;
+                    _unlock();
+                    if(closing)return;
+                    continue;
+                }
+                entry_t e=jobs[shared->job_head%capacity];
+                shared->job_head++;
+                slots[w].busy=true;
+                slots[w].entry=e;
+                _unlock();
+
+                result_t r;
+                r.entry=e;
+                try{
+                    auto start=std::chrono::steady_clock::now();
+                    r.ret_val=cc.run(e.job);
+                    r.duration=std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now()-start).count();
+                }
+                catch(...){
+                    r.exception=true;
+                }
+
+                //Publishing the result and releasing the job happen together, so a crash can never count a job twice.
+                _lock();
+                results[shared->result_tail%_result_capacity()]=r;
+                shared->result_tail++;
+                slots[w].busy=false;
+                _unlock();
+                sem_post(&shared->results_ready);
+            }
+        }
+
+        void _shutdown(){
+            _lock();
+            shared->closing=true;
+            _unlock();
+            for(uint i=0;i<max_queue;i++)sem_post(&shared->jobs_ready);
+            for(pid_t pid:pids){
+                if(pid>0)waitpid(pid,nullptr,0);
+            }
+            pids.clear();
+        }
+
+        static std::string _describe(int status){
+            if(WIFSIGNALED(status))return std::string("signal ")+strsignal(WTERMSIG(status));
+            if(WIFEXITED(status))return "exit code "+std::to_string(WEXITSTATUS(status));
+            return "unknown status";
+        }
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+/**
+ * @file result-cache.h
+ * @author karurochari
+ * @brief Content-addressed cache of completed instances, shared by the runs of a machine.
+ * @version 0.1
+ * @date 2020-07-22
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <string_view>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cerrno>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#include <nlohmann/json.hpp>
+
+#include "hashing.h"
+
+/**
+ * @brief A directory of results, each one stored under the digest of everything which determines it.
+ * An entry is a directory holding the files left by an instance in its workspace, and a `result.json` with its steps, checksum and any other data of the runner.
+ * ```
+ * %directory/%digest[0:2]/%digest/result.json
+ * %directory/%digest[0:2]/%digest/status ...
+ * ```
+ * Entries are built aside and renamed into place, so they are either complete or absent, and several runs can share the same cache.
+ */
+struct result_cache{
+    /**
+     * @param _directory the root of the cache, created if missing.
+     */
+    result_cache(const std::string& _directory):directory(_directory){
+        std::filesystem::create_directories(directory+"/tmp");
+    }
+
+    result_cache(const result_cache&)=delete;
+
+    /**
+     * @brief The digest of a canonical description, as 32 hex digits.
+     * Two FNV-1a streams with different offsets are combined, which is plenty against accidental collisions but not against crafted ones.
+     */
+    static std::string digest(std::string_view canonical){
+        return to_hex(mix64(fnv1a64(canonical)))+to_hex(mix64(fnv1a64(canonical,0x84222325cbf29ce4ull)));
+    }
+
+    /**
+     * @brief The result of an entry, if it is in the cache.
+     */
+    std::optional<nlohmann::json> lookup(const std::string& key){
+        std::ifstream in(_path(key)+"/result.json");
+        if(!in){_misses++;return {};}
+        try{
+            nlohmann::json ret=nlohmann::json::parse(in);
+            _hits++;
+            return ret;
+        }
+        catch(...){
+            _misses++;
+            return {};
+        }
+    }
+
+    /**
+     * @brief Place the files of an entry in a directory, replacing those with the same name.
+     * Files are cloned when the filesystem supports it, and copied otherwise: a later run may append to them, so they never share an inode with the entry.
+     * @return false if any file could not be placed.
+     */
+    bool materialize(const std::string& key, const std::string& destination){
+        std::error_code ec;
+        bool ok=true;
+        for(auto& f:std::filesystem::directory_iterator(_path(key),ec)){
+            const std::string name=f.path().filename();
+            if(name=="result.json" || !f.is_regular_file())continue;
+            ok&=_place(f.path(),destination+"/"+name);
+        }
+        return ok && !ec;
+    }
+
+    /**
+     * @brief Remove an entry found to be damaged, counting its lookup as a miss.
+     */
+    void evict(const std::string& key){
+        std::error_code ec;
+        std::filesystem::remove_all(_path(key),ec);
+        _hits--;
+        _misses++;
+    }
+
+    /**
+     * @brief Store the files of a directory as an entry, unless it is already there.
+     * The files are copied, so that the workspace and the cache never share an inode written later on.
+     */
+    void store(const std::string& key, const std::string& source, const nlohmann::json& result){
+        const std::string final_path=_path(key);
+        std::error_code ec;
+        if(std::filesystem::exists(final_path+"/result.json",ec))return;
+
+        std::hash<std::thread::id> h;
+        const std::string tmp=directory+"/tmp/"+key+"."+std::to_string(getpid())+"."+to_hex(h(std::this_thread::get_id()));
+        std::filesystem::remove_all(tmp,ec);
+        std::filesystem::create_directories(tmp,ec);
+        if(ec){_failures++;return;}
+
+        for(auto& f:std::filesystem::directory_iterator(source,ec)){
+            if(!f.is_regular_file())continue;
+            std::filesystem::copy_file(f.path(),tmp+"/"+f.path().filename().string(),ec);
+            if(ec)break;
+        }
+        if(!ec){
+            std::ofstream out(tmp+"/result.json");
+            out<<result.dump();
+            out.close();
+            if(!out)ec=std::make_error_code(std::errc::io_error);
+        }
+        if(!ec){
+            std::filesystem::create_directories(std::filesystem::path(final_path).parent_path(),ec);
+            //Another run may have stored the same entry meanwhile, in which case the rename fails and ours is dropped.
+            if(!ec && rename(tmp.c_str(),final_path.c_str())==0){
+                _stored++;
+                return;
+            }
+        }
+        std::filesystem::remove_all(tmp,ec);
+        if(!std::filesystem::exists(final_path+"/result.json",ec))_failures++;
+    }
+
+    inline uint64_t hits() const{return _hits.load(std::memory_order_relaxed);}
+    inline uint64_t misses() const{return _misses.load(std::memory_order_relaxed);}
+    inline uint64_t stored() const{return _stored.load(std::memory_order_relaxed);}
+    inline uint64_t failures() const{return _failures.load(std::memory_order_relaxed);}
+
+    private:
+        std::string             directory;
+
+        std::atomic<uint64_t>   _hits=0;
+        std::atomic<uint64_t>   _misses=0;
+        std::atomic<uint64_t>   _stored=0;
+        std::atomic<uint64_t>   _failures=0;
+
+        inline std::string _path(const std::string& key) const{return directory+"/"+key.substr(0,2)+"/"+key;}
+
+        static bool _place(const std::filesystem::path& from, const std::string& to){
+            unlink(to.c_str());
+
+            int src=open(from.c_str(),O_RDONLY);
+            if(src>=0){
+                int dst=open(to.c_str(),O_WRONLY|O_CREAT|O_TRUNC,0644);
+                if(dst>=0){
+                    const bool cloned=ioctl(dst,FICLONE,src)==0;
+                    close(dst);
+                    close(src);
+                    if(cloned)return true;
+                    unlink(to.c_str());
+                }
+                else close(src);
+            }
+
+            std::error_code ec;
+            std::filesystem::copy_file(from,to,std::filesystem::copy_options::overwrite_existing,ec);
+            return !ec;
+        }
+};
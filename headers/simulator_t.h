@@ -15,6 +15,16 @@
 #include <string>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
+#include <span>
+#include <vector>
+#include <concepts>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <limits>
+#include <map>
+#include <csignal>
 
 
 //Source location is not fully supported, come back later.
@@ -25,21 +35,143 @@
 
 #include "string-exception.h"
 #include "workers-queue.h"
+#include "trace-format.h"
+#include "io-writer.h"
+#include "manifest.h"
+#include "counter-rng.h"
+#include "packed-workspace.h"
+#include "online-stats.h"
+#include "callback-dispatcher.h"
+#include "hashing.h"
+#include "json-writer.h"
+#include "checkpoint-policy.h"
+#include "process-queue.h"
+#include "lease-coordinator.h"
+#include "phase-metrics.h"
+#include "status-page.h"
+#include "result-cache.h"
+#include "parameter-sweep.h"
+#include "coroutine-queue.h"
+#include "trajectory-ring.h"
+#include "task-arena.h"
+#include "delta-checkpoint.h"
 
-//Concepts. At the moment they are not fully supported, come back later.
+/**
+ * @brief The interface every model must have.
+ * Besides the types of its state, model state, delta state and end condition, it must tell whether it is `differential`
+ * (its call operator returns a delta to be added to the state) and `recoverable` (its model state can be restored from a previous run).
+ */
+template<typename T>
+concept ModelType = requires(const nlohmann::json& j, T& m){
+    typename T::state_t;
+    typename T::mstate_t;
+    typename T::delta_state_t;
+    typename T::termination_t;
+    {T::differential} -> std::convertible_to<bool>;
+    {T::recoverable} -> std::convertible_to<bool>;
+    from_json(j,m);
+};
+
+/**
+ * @brief A model whose call operator returns a delta, instead of the next state.
+ */
+template<typename T>
+concept DifferentialModelType = ModelType<T> && T::differential;
+
+/**
+ * @brief A model whose model state can be restored from the files of a previous run.
+ */
+template<typename T>
+concept RecoverableModelType = ModelType<T> && T::recoverable;
+
+/**
+ * @brief A model drawing from the random stream of its instance.
+ * Models are assumed to be randomized, unless they define `randomized` as false. The position of the stream is only saved for randomized ones.
+ */
+template<typename T>
+concept RandomizedModelType = ModelType<T> && !requires(){
+    requires !T::randomized;
+};
+
+/**
+ * @brief A model whose states can be copied as plain bytes, as needed by the raw trace format.
+ */
+template<typename T>
+concept TriviallyCopyableModelType = ModelType<T> && std::is_trivially_copyable_v<typename T::state_t> && std::is_trivially_copyable_v<typename T::delta_state_t>;
+
+/**
+ * @brief A model declaring itself able to advance several instances at once, whether or not its call operator matches.
+ */
+template<typename T>
+concept BatchedDeclaredType = requires(){
+    requires T::batched;
+    {T::lanes} -> std::convertible_to<uint>;
+};
+
+/**
+ * @brief A model able to advance several instances at once, with environments of type E.
+ * Besides the usual interface, it must define `lanes`, the default number of instances advanced together, and a call operator
+ * ```
+ * template<typename E>
+ * void operator()(std::span<state_t> s, std::span<mstate_t> m, std::span<const uint8_t> active, std::span<const E* const> env) const;
+ * ```
+ * advancing in place each state whose `active` flag is set, and leaving untouched all the others.
+ * Differential models instead write the delta of each active state, which is then added to it:
+ * ```
+ * template<typename E>
+ * void operator()(std::span<delta_state_t> d, std::span<const state_t> s, std::span<mstate_t> m, std::span<const uint8_t> active, std::span<const E* const> env) const;
+ * ```
+ * If the call throws, the step is repeated for each active instance on its own, from the same states and random streams, so that only the failing ones are lost.
+ * Model states are not rolled back, so a call should not change them before throwing.
+ */
+template<typename T, typename E>
+concept BatchedModelType = ModelType<T> && BatchedDeclaredType<T> && (
+    (DifferentialModelType<T> && requires(const T& m, std::span<typename T::delta_state_t> d, std::span<const typename T::state_t> s, std::span<typename T::mstate_t> ms, std::span<const uint8_t> a, std::span<const E* const> e){
+        m(d,s,ms,a,e);
+    }) ||
+    (!DifferentialModelType<T> && requires(const T& m, std::span<typename T::state_t> s, std::span<typename T::mstate_t> ms, std::span<const uint8_t> a, std::span<const E* const> e){
+        m(s,ms,a,e);
+    })
+);
+
+/**
+ * @brief A model exposing observables, to be aggregated across the instances of a batch.
+ * It must define `observables`, a container with their names, and
+ * ```
+ * void observe(const state_t& s, std::span<double> values) const;
+ * ```
+ * writing the value of each of them for a state.
+ */
+template<typename T>
+concept ObservableModelType = requires(const T& m, const typename T::state_t& s, std::span<double> o){
+    {T::observables.size()} -> std::convertible_to<size_t>;
+    m.observe(s,o);
+};
+
+/**
+ * @brief Callbacks are built from their configuration, and called with the task, batch or simulator they notify.
+ */
 template<typename T>
-concept ModelType = requires(){
-    true;
+concept CallbackType = std::default_initializable<T> && requires(const nlohmann::json& j, T& c){
+    from_json(j,c);
 };
 
+/**
+ * @brief A callback which can be run away from the simulation threads.
+ * `deferred()` must return a self-contained job doing what the call operator would, and `min_interval()` the minimum time between two of its notifications for the same instance.
+ */
 template<typename T>
-concept CallbackType = requires(){
-    true;
+concept DeferrableCallbackType = requires(const T& c){
+    {c.deferred()} -> std::convertible_to<std::function<void()>>;
+    {c.min_interval()} -> std::convertible_to<std::chrono::milliseconds>;
 };
 
+/**
+ * @brief Tweaks are only built from their configuration, their content is up to the application.
+ */
 template<typename T>
-concept TweaksType = requires(){
-    true;
+concept TweaksType = std::default_initializable<T> && requires(const nlohmann::json& j, T& t){
+    from_json(j,t);
 };
 
 /**
@@ -64,10 +196,15 @@ struct simulator_t{
         struct task_batch_t;
         struct task_t;
         struct const_iterator;
+        struct burn_in_t;
+        struct statistics_t;
+        struct adaptive_t;
+        struct sweep_t;
 
         friend task_batch_t;
         friend task_t;
         friend const_iterator;
+        friend process_queue<simulator_t>;
 
         typedef MODEL_T     model_t;
         typedef CALLBACK_T  callback_t;
@@ -104,24 +241,407 @@ struct simulator_t{
                 uint                            instances=1;            ///< The number of tasks to be spawaned with this same initial configuration.
                 uint                            sync=0;                 ///< How many simulation steps I have to skip way before synchronizing with my storage.
                 uint                            backup=0;               ///< How many synchronization steps I have to skip before updateing the backup copy.
+                checkpoint_policy_t             checkpoint_policy=checkpoint_policy_t::steps;  ///< How the interval between two synchronizations is chosen.
+                uint                            checkpoint_interval_ms=1000;    ///< The interval of the time policy, or the longest one of the overhead policy.
+                double                          checkpoint_overhead=0.02;       ///< The fraction of time which can be spent checkpointing with the overhead policy.
+                bool                            delta_checkpoints=false;        ///< Are the states saved as patches against a snapshot, instead of in full at each sync?
+                uint                            snapshot_every=16;              ///< How many syncs share the same snapshot with delta checkpoints.
+                bool                            compress_deltas=false;          ///< Are the patches of the delta checkpoints compressed?
                 bool                            save_trace=true;        ///< Should the trace be saved or only the final state?
                 bool                            save_mstate=false;      ///< Should I save the model state?
+                trace_format_t                  trace_format=trace_format_t::json;  ///< How the records of the trace are encoded.
+                uint64_t                        trace_buffer=0;         ///< The memory in bytes for the records of an instance not yet in its backup trace.
+                uint                            lanes=1;                ///< How many instances are advanced together, only for batched models.
+                int                             priority=0;             ///< With the sliced scheduler, instances of batches with higher priority get their slices first.
+                std::unique_ptr<burn_in_t>      burn_in;                ///< The optional warm-up shared by all the instances.
+                std::unique_ptr<statistics_t>   statistics;             ///< The optional aggregation of the observables across the instances.
+                std::unique_ptr<adaptive_t>     adaptive;               ///< The optional sequential sampling, which stops the batch once an observable of the final states has converged. Its instances are then a cap.
+
+                std::shared_ptr<const model_t>  model;                  ///< The model of its instances, shared by all the batches which do not patch it.
+
+                uint                            index=0;                ///< Its position among the batches, as in the jobs.
+                uint                            slot=0;                 ///< Its batch in the status page, shared by all the points of a sweep.
+                std::string                     canonical;              ///< The parameters determining the results of its instances, as canonical JSON.
+                std::string                     cache_prefix;           ///< The digest of everything determining the results of its instances, but their id.
+                bool                            cached=false;           ///< Are its instances looked up in the result cache?
 
                 const simulator_t&              parent;                 ///< A reference to the parent simulation.
         };
 
+        /**
+         * @brief A warm-up phase run once for a whole batch. All its instances start from the state it reached.
+         */
+        struct burn_in_t{
+            /**
+             * @brief The state reached by the warm-up, kept read-only for all the instances of the batch.
+             * Each instance starts from a copy of it, as models advance their states in place.
+             */
+            struct snapshot_t{
+                typename model_t::state_t   state;
+                typename model_t::mstate_t  mstate;
+                uint64_t                    steps=0;
+            };
+
+            typename model_t::termination_t     end_condition;          ///< When the warm-up is over.
+            std::optional<uint64_t>             seed;                   ///< The seed of the warm-up random stream, the global one if not set.
+            std::once_flag                      once;
+            std::shared_ptr<const snapshot_t>   snapshot;
+        };
+
+        /**
+         * @brief The aggregation of the model observables across all the instances of a batch.
+         */
+        struct statistics_t{
+            uint                                bin=1;                  ///< The number of steps in each bin. Observables are sampled on the first step of each bin.
+            std::vector<double>                 quantiles={0.05,0.5,0.95};  ///< The quantiles to be reported.
+            double                              accuracy=0.01;          ///< The relative accuracy of the quantiles.
+            std::vector<ensemble_stats>         per_worker;             ///< The aggregates of the completed instances, one for each worker so that merging needs no locking.
+        };
+
+        /**
+         * @brief Sequential sampling of a batch: its instances are run until the mean of an observable of their final states is known precisely enough.
+         */
+        struct adaptive_t{
+            uint                                observable=0;           ///< The index of the observable among those of the model.
+            sequential_estimate                 estimate;
+        };
+
+        /**
+         * @brief A batch expanded into one batch for each point of a parameter sweep, generated only when the iterator reaches it.
+         */
+        struct sweep_t{
+            std::string                         name;
+            nlohmann::json                      base;                   ///< The template of the batches, without its sweep.
+            parameter_sweep                     points;
+            uint                                first=0;                ///< The index of the batch of its first point.
+            uint                                slot=0;                 ///< Its batch in the status page.
+        };
+
         struct task_t{
-            typedef std::vector<typename model_t::delta_state_t> trajectory_t;
-            task_t(const task_batch_t& p, uint _id);
+            friend simulator_t;
+            typedef typename trajectory_pool<typename model_t::delta_state_t>::handle_t trajectory_t;
+
+            /**
+             * @brief The output or error stream of a task.
+             * In the directory layout it is written in its file as it goes, so that nothing is lost if the process dies.
+             * In the packed one it is kept in memory, and appended to its file at each checkpoint and when the task is over.
+             */
+            struct log_t{
+                std::ofstream       file;
+                std::ostringstream  buffer;
+
+                template<typename X>
+                log_t& operator<<(const X& x){
+                    if(file.is_open())file<<x;
+                    else buffer<<x;
+                    return *this;
+                }
+
+                /**
+                 * @brief Open the file of the stream, for the directory layout.
+                 */
+                void open(const std::string& path){
+                    file.open(path,std::ios_base::app);
+                    file.setf(std::ios_base::unitbuf);
+                }
+
+                inline bool pending(){return !file.is_open() && buffer.tellp()>0;}
+            };
+
+            /**
+             * @param p the batch.
+             * @param _id the instance.
+             * @param _resume should the instance resume from its backup copies, as in continue mode?
+             */
+            task_t(const task_batch_t& p, uint _id, bool _resume=false);
+            task_t(task_t&& c)=default;
             int operator()();
 
+            /**
+             * @brief Run a group of instances of the same batch in lockstep, one lane each. Only available for batched models.
+             * @param p the batch.
+             * @param first the id of the first lane.
+             * @param count the number of lanes.
+             * @param resume should the lanes resume from their backup copies?
+             * @return 0 if all the lanes were properly completed.
+             */
+            static int run_lanes(const task_batch_t& p, uint first, uint count, bool resume=false);
+
+            /**
+             * @brief Run an instance as a coroutine, suspended at the first checkpoint after each slice of time. Groups of lanes are run in a single slice.
+             * @param p the batch, kept alive as long as the coroutine.
+             * @param first the id of the instance, or of the first lane.
+             * @param count the number of lanes.
+             * @param slice the length of a slice.
+             * @return the exit code of the task.
+             */
+            static task_slice run_sliced(std::shared_ptr<const task_batch_t> p, uint first, uint count, std::chrono::milliseconds slice);
+
+            /**
+             * @brief The random stream of this instance, to be used by the model through its environment.
+             * It is seeded from the global seed, the batch name and the instance id, and its position is saved in every status.
+             */
+            inline philox_rng& rng() const{return rng_state;}
+
+            /**
+             * @brief The arena of this instance, to be used by the model through its environment for what lives no longer than the instance.
+             * Everything allocated in it is freed at once when the instance is over.
+             */
+            inline std::pmr::memory_resource* arena() const{return memory->resource();}
+
             private:
+                const task_batch_t&             parent;                 ///< A reference to the task pool this instance is part of.
+                arena_pool::handle_t            memory;                 ///< The arena of this instance. It is declared first, so that the states and everything else allocated in it are destroyed before it is given back.
+
                 uint                            id;
+                bool                            resume=false;           ///< Is it resuming from its backup copies, as in continue mode?
                 typename model_t::state_t       current_state;          ///< The current state of the simulation instance.
-                trajectory_t                    trajectory;             ///< All the events up to this point which have not been copied on disk yet. If save_trace is set to false it is empty.
+                trajectory_t                    trajectory;             ///< The events up to this point which have not been copied in the backup trace yet. If save_trace is set to false it is null.
+                uint                            synced=0;               ///< How many records of the trajectory have already been written in the trace.
                 typename model_t::mstate_t      model_state;            ///< The expanded variables for the model state as it is evolving as well.                                                 
 
-                const task_batch_t&             parent;                 ///< A reference to the task pool this instance is part of.
+                log_t                           out;                    ///< The output stream of this task.
+                log_t                           err;                    ///< The error stream of this task.
+                std::string                     task_name;              ///< The name of the task, as batch/id.
+                std::string                     dir;                    ///< The directory of this task in the workspace.
+                mutable std::string             path_buffer;            ///< Where the paths handed to the writer stage are built, reused so that they do not allocate.
+                mutable std::string             target_buffer;          ///< The same, for the targets of links.
+                size_t                          io_key=0;               ///< The key used to keep the writes of this task ordered.
+                std::string                     status_buffer;          ///< The serialized state of the last sync, reused for the backup.
+                std::string                     mstatus_buffer;         ///< The serialized model state of the last sync, reused for the backup.
+                uint64_t                        trace_bytes=0;          ///< The size of the trace file, once all the queued writes are performed.
+                uint64_t                        trace_copy_bytes=0;     ///< The size of the trace backup file, once all the queued writes are performed.
+                uint64_t                        trace_records=0;        ///< The records in the trace file, once all the queued writes are performed.
+                uint64_t                        generation=0;           ///< The number of the last sync, as published in its header.
+                uint64_t                        steps=0;                ///< The number of steps performed, including those of previous runs.
+                mutable philox_rng              rng_state;              ///< The random stream of this instance.
+                std::unique_ptr<ensemble_stats> observed;               ///< The observables sampled by this instance, merged with the batch once completed.
+                std::pmr::vector<double>        observation;            ///< The values of the last sample.
+                std::string                     observed_log;           ///< The samples taken since the last sync, appended to the `observed` file with it.
+                checkpoint_planner              planner;                ///< Decides when the next checkpoint is due.
+                uint64_t                        next_sync=0;            ///< The step of the next checkpoint.
+                uint64_t                        next_probe=0;           ///< The step at which the planner next reads the clock.
+                delta_stream                    status_delta;           ///< The snapshot of the status and the patch of the last sync, with delta checkpoints.
+                delta_stream                    mstatus_delta;          ///< The same for the model state.
+                bool                            snapshot_due=false;     ///< Should the next sync take a new snapshot, with delta checkpoints?
+                status_worker_t*                live=nullptr;           ///< The slot of the status page of the worker running it, if any.
+                uint64_t                        live_steps=0;           ///< The steps at the last checkpoint, to measure the rate.
+                uint64_t                        live_ns=0;              ///< The time of the last checkpoint, to measure the rate.
+                std::string                     cache_key;              ///< Its entry in the result cache.
+                bool                            cancelled=false;        ///< Was it stopped because its batch had converged?
+
+                /**
+                 * @brief Set the name and the directory of the task.
+                 */
+                void _paths();
+
+                /**
+                 * @brief Prepare the files of the task, and load its initial state.
+                 */
+                void _begin();
+
+                /**
+                 * @brief Complete the task from the result cache, when it holds the same instance.
+                 * @return true if it did.
+                 */
+                bool _restore_cached();
+
+                /**
+                 * @brief Store the files and the result of the completed task in the result cache.
+                 */
+                void _store_cached();
+
+                /**
+                 * @brief Notify the callbacks of a completed task.
+                 * @param converged did it make its adaptive batch converge?
+                 */
+                void _completed_callbacks(bool converged=false);
+
+                /**
+                 * @brief Add the final state to the estimate of an adaptive batch, or give up its sample if the instance failed.
+                 * @return true if it made the batch converge, possibly with the samples of later instances it was holding back.
+                 */
+                bool _sample(bool failed=false);
+
+                /**
+                 * @brief Is its adaptive batch already converged, making it surplus?
+                 */
+                inline bool _surplus() const{return parent.adaptive && parent.adaptive->estimate.converged();}
+
+                /**
+                 * @brief Leave out a surplus task, before it starts or at a checkpoint. It is not recorded in the manifest.
+                 * @param started was it started already?
+                 * @return the exit code of the task.
+                 */
+                int _cancel(bool started);
+
+                /**
+                 * @brief Advance the instance until its end condition, or until the first checkpoint past a deadline.
+                 * @return true once the end condition is met.
+                 */
+                bool _run(std::chrono::steady_clock::time_point deadline);
+
+                /**
+                 * @brief The steps of _run, specialized for the policy of the batch.
+                 * @tparam TRACE is the trajectory saved?
+                 * @tparam EVENT is there an event callback?
+                 * @tparam OBSERVE are the observables aggregated?
+                 */
+                template<bool TRACE, bool EVENT, bool OBSERVE>
+                bool _loop(std::chrono::steady_clock::time_point deadline);
+
+                /**
+                 * @brief Move the live status of a resumed instance to the slot of the worker now running it.
+                 */
+                void _rebind();
+
+                /**
+                 * @brief Set the state a new instance starts from, running the burn-in of the batch if needed.
+                 */
+                void _initial();
+
+                /**
+                 * @brief Run the burn-in of a batch, or load it if a previous run did it already.
+                 */
+                static std::shared_ptr<const typename burn_in_t::snapshot_t> _burn_in(const task_batch_t& p);
+
+                /**
+                 * @brief Is a sync due at the current step?
+                 */
+                bool _checkpoint_due() const;
+
+                /**
+                 * @brief Stop an instance of a distributed run whose lease could have been given to another worker, before it writes anything else.
+                 */
+                inline void _fence() const{if(!lease_client::holds())throw StringException("LeaseLostException");}
+
+                /**
+                 * @brief Bring the next checkpoint to the current step if the time planned for it has already passed, reading the clock only when the planner asks for it.
+                 */
+                bool _overdue();
+
+                /**
+                 * @brief Sync, and backup if needed, when the current step requires it.
+                 */
+                void _checkpoint();
+
+                /**
+                 * @brief Sample the observables of a state, if the current step is the first of a bin.
+                 */
+                void _observe(const typename model_t::state_t& s);
+
+                /**
+                 * @brief Restore the observables sampled before the current step, from the `observed` file, or from the status saved by older versions.
+                 */
+                void _restore_observed(const nlohmann::json& status);
+
+                /**
+                 * @brief Start from the initial state when nothing left by the previous run can be resumed, dropping the samples it logged.
+                 */
+                void _start_over();
+
+                /**
+                 * @brief Sync and backup out of schedule, when the trajectory has filled its ring.
+                 */
+                void _spill();
+
+                /**
+                 * @brief Publish in the status page the time of a checkpoint, and the rate since the previous one.
+                 */
+                void _published();
+
+                /**
+                 * @brief Report an exception raised by the simulation.
+                 * @return the exit code of the task.
+                 */
+                int _fail(const std::exception& e);
+
+                /**
+                 * @brief Save the final state and run the callbacks.
+                 * @return the exit code of the task.
+                 */
+                int _finish();
+
+                /**
+                 * @brief Save the state, the model state and the new records of the trajectory.
+                 */
+                void _sync();
+
+                /**
+                 * @brief Update the backup copies with the content of the last sync.
+                 */
+                void _backup();
+
+                /**
+                 * @brief Write the content of a sync in a file, or its patch in the log of the file with delta checkpoints.
+                 */
+                void _save(const std::string& file, const std::string& buffer, delta_stream& stream);
+
+                /**
+                 * @brief Write the content of the last sync in the backup copy of a file, or its patch in the log of the copy with delta checkpoints.
+                 */
+                void _save_copy(const std::string& file, const std::string& buffer, delta_stream& stream);
+
+                /**
+                 * @brief Parse a file left by a previous run, replaying its log if it has one.
+                 */
+                nlohmann::json _load(const std::string& file, const std::string& content) const;
+
+                /**
+                 * @brief Are the checkpoints published as generations, each with a header, and backed up by linking them?
+                 * Only in the directory layout and with the full encoding.
+                 */
+                inline bool _generational() const{return !parent.parent.packed && !parent.delta_checkpoints;}
+
+                /**
+                 * @brief Resume from the newest generation whose files are all valid, the last sync or else the last backup.
+                 * @return false if there is none, as in workspaces left by older versions.
+                 */
+                bool _resume_generation();
+
+                /**
+                 * @brief Make a trace the one of the task, cut back to the size it had when resuming.
+                 * Generations share a single trace, only ever appended to, so the trace of any of them is a prefix of it and resuming from one only truncates it.
+                 * @param from the trace to be kept, `trace` or the `trace.copy` left by an older version, which is renamed over it.
+                 * @return false if the files could not be changed.
+                 */
+                bool _cut_trace(const std::string& from, uint64_t bytes, uint64_t records);
+
+                /**
+                 * @brief Read a file of this task left by a previous run, whatever the workspace layout.
+                 * @return false if the file is not there.
+                 */
+                bool _read(const std::string& file, std::string& content) const;
+
+                /**
+                 * @brief The size of a file of this task left by a previous run, whatever the workspace layout.
+                 */
+                uint64_t _size(const std::string& file) const;
+
+                /**
+                 * @brief Hand the output and error streams to the writer stage, in the packed layout.
+                 */
+                void _flush_streams();
+
+                /**
+                 * @brief Hand a buffer to the writer stage, to be written in a file of this task.
+                 */
+                void _write(std::string_view file, io_writer::op_t op, std::string buffer) const;
+
+                /**
+                 * @brief Have the writer stage make a file of this task another name of one of its files.
+                 */
+                void _link(std::string_view file, std::string_view target) const;
+
+                /**
+                 * @brief A copy of a buffer, in one recycled by the writer stage.
+                 */
+                std::string _copy(const std::string& buffer) const;
+
+                /**
+                 * @brief Append a range of the trajectory to a trace file, and to its index for the binary formats.
+                 */
+                void _append_trace(const std::string& file, uint64_t& size, uint from, uint to) const;
 
         };
 
@@ -129,40 +649,112 @@ struct simulator_t{
             private:
                 friend simulator_t;
 
-                const std::map<std::string,task_batch_t>& r;
-                typename std::map<std::string,task_batch_t>::const_iterator it;
-                uint residual=0;
+                const simulator_t& sim;
+                uint index=0;               ///< The batch of the current group.
+                std::shared_ptr<const task_batch_t> batch;  ///< The current batch, kept alive by the tasks of its instances when it is the point of a sweep.
+                uint residual=0;            ///< The number of instances of the current batch not yet handed out, after the current group.
+                uint first=0;               ///< The first instance of the current group.
+                uint count=1;               ///< The number of instances in the current group, starting from first.
+
+                const_iterator(const simulator_t& ref):sim(ref){}
+
+                /**
+                 * @brief Move to the next instance, regardless of it being already completed or not.
+                 */
+                void _advance(){
+                    for(;residual==0 && index<sim.batch_count;){
+                        index++;
+                        batch=(index<sim.batch_count)?sim._batch(index):nullptr;
+                        residual=batch?batch->instances:0;
+                    }
+
+                    if(index<sim.batch_count){
+                        count=std::min(batch->lanes,residual);
+                        residual-=count;
+                        //The estimate of an adaptive batch takes its samples in the order of the instances, so they are handed out in that order too.
+                        first=batch->adaptive?batch->instances-residual-count:residual;
+                    }
+                }
+
+                /**
+                 * @brief Leave out the instances of the current batch not yet handed out, as it has converged.
+                 */
+                void _drop(){
+                    uint64_t n=0;
+                    const uint from=batch->adaptive?first:0;
+                    for(uint i=0;i<residual+count;i++)n+=sim.manifest->completed(batch->name+"/"+std::to_string(from+i))?0:1;
+                    if(sim.status.valid()){
+                        sim.status.header().total.fetch_sub(n,std::memory_order_relaxed);
+                        sim.status.header().queued.fetch_sub(n,std::memory_order_relaxed);
+                    }
+                    residual=0;
+                }
 
-                const_iterator(const std::map<std::string,task_batch_t>& ref):r(ref){}
+                /**
+                 * @brief Have all the instances of the current group been completed by a previous run?
+                 */
+                bool _completed() const{
+                    for(uint i=0;i<count;i++){
+                        if(!sim.manifest->completed(batch->name+"/"+std::to_string(first+i)))return false;
+                    }
+                    return true;
+                }
 
             public:
-                std::string where(){return it->first+"/"+std::to_string(residual);}
+                std::string where(){return batch->name+"/"+std::to_string(first);}
                 std::function<int()> operator*(){
                     //If not my iterator will have changed by the time I am using it in the lambda.
                     auto cpit=*this;
+                    if(cpit.count>1){
+                        return std::function<int()>([cpit]()->int{
+                            return task_t::run_lanes(*cpit.batch,cpit.first,cpit.count);
+                        });
+                    }
                     return std::function<int()>([cpit]()->int{
-                        task_t tmp(cpit.it->second,cpit.residual);return tmp();
+                        task_t tmp(*cpit.batch,cpit.first);return tmp();
                     });
                 }
-                friend bool operator!=(const const_iterator& a, const const_iterator& b){return (a.residual!=b.residual) or (a.it!=b.it);}
+                friend bool operator!=(const const_iterator& a, const const_iterator& b){return (a.residual!=b.residual) or (a.index!=b.index);}
+
+                /**
+                 * @brief The current group as a coroutine, for the sliced scheduler.
+                 */
+                task_slice slice() const{return task_t::run_sliced(batch,first,count,std::chrono::milliseconds(sim.slice_ms));}
+
+                inline int priority() const{return batch->priority;}
+
+                /**
+                 * @brief The current group as plain integers, to be sent to a worker process.
+                 */
+                process_job_t key() const{
+                    return {index,first,count,0};
+                }
                 
+                /**
+                 * @brief Move to the next instance, skipping those the manifest reports as completed.
+                 */
                 const_iterator& operator++(){
-                    for(;residual==0 && it!=r.end();){
-                        it++;
-                        if(it!=r.end())residual=it->second.instances;
-                        else residual=0;
-                    }
-
-                    if(it!=r.end()){
-                        residual--;
+                    for(;;){
+                        _advance();
+                        if(!(index<sim.batch_count))break;
+                        //Once an adaptive batch converges, the rest of it is dropped at once.
+                        if(batch->adaptive && batch->adaptive->estimate.converged()){_drop();continue;}
+                        if(!_completed())break;
                     }
                     return *this;
                 }
         };
 
 
-        inline const_iterator begin() const{const_iterator ret(task_batches);ret.it=task_batches.begin();ret.residual=ret.it->second.instances;++ret;return ret;}
-        inline const_iterator end() const{const_iterator ret(task_batches);ret.it=task_batches.end();ret.residual=0;return ret;}
+        inline const_iterator begin() const{
+            const_iterator ret(*this);
+            if(batch_count==0)return end();
+            ret.batch=_batch(0);
+            ret.residual=ret.batch?ret.batch->instances:0;
+            ++ret;
+            return ret;
+        }
+        inline const_iterator end() const{const_iterator ret(*this);ret.index=batch_count;ret.residual=0;return ret;}
 
     private:
         std::ostream&                       out;
@@ -177,6 +769,45 @@ struct simulator_t{
         std::string                         license;            ///< The adopted license. By default it is considered as not permissive and commercial.
 
         std::map<std::string,task_batch_t>  task_batches;       ///< The batches of tasks to be executed.
+        std::vector<sweep_t>                sweeps;             ///< The batches expanded by a parameter sweep, numbered after all the others.
+        uint                                batch_count=0;      ///< The number of batches, counting each point of a sweep.
+        nlohmann::json                      model_json;         ///< The patched model, patched again by the sweeps changing it.
+        mutable std::mutex                  sweep_m;
+        mutable std::map<std::string,std::weak_ptr<const model_t>> sweep_models;   ///< The models patched by the points still alive, by their canonical JSON.
+        mutable std::shared_ptr<const task_batch_t> last_point; ///< The last point generated, since consecutive jobs are likely to share it.
+
+        uint                                io_writers=1;       ///< The number of writer threads.
+        uint                                io_queue=256;       ///< The number of pending writes for each writer before the simulation threads are blocked.
+        durability_t                        durability=durability_t::none;  ///< When the written files are forced on disk.
+        uint                                group_commit_ms=50; ///< The maximum interval between group commits.
+        std::unique_ptr<io_writer>          io;                 ///< The writer stage, only alive while the simulation is running.
+        std::unique_ptr<completion_manifest> manifest;          ///< The record of the completed instances of the workspace.
+        uint64_t                            seed=0;             ///< The global seed of the random streams.
+        bool                                packed=false;       ///< Are the files of the instances stored in segments instead of their own directories?
+        bool                                compact=true;       ///< Should the segments of a packed workspace be compacted at the end of the run?
+        std::unique_ptr<packed_workspace>   previous;           ///< The content of a packed workspace left by the previous runs, only in continue mode.
+        uint                                dispatcher_threads=1;   ///< How many callbacks can run concurrently.
+        uint                                dispatcher_queue=1024;  ///< How many notifications can be pending before new ones are dropped.
+        std::unique_ptr<callback_dispatcher> dispatcher;        ///< The threads running the callbacks, only alive while the simulation is running.
+        bool                                slicing=false;      ///< Are the instances run in slices by coroutine_queue, instead of each one to its end?
+        uint                                slice_ms=50;        ///< The length of a slice.
+        uint                                in_flight=0;        ///< How many instances can be in flight with the sliced scheduler, 4 for each worker if 0.
+        bool                                isolated=false;     ///< Are the instances run in worker processes instead of threads?
+        uint                                retries=2;          ///< How many times an instance whose worker process crashed is resumed.
+        std::string                         role;               ///< `coordinator` or `worker` when the run is distributed, empty otherwise.
+        std::string                         address;            ///< The endpoint of the coordinator.
+        uint                                lease_chunk=4;      ///< How many instances are leased to a worker at once.
+        uint                                lease_ms=30000;     ///< How long a silent worker keeps its lease.
+        bool                                status_enabled=true;    ///< Should the live progress be published in the status page of the workspace?
+        status_page                         status;             ///< The status page, only mapped while the simulation is running.
+        std::unique_ptr<result_cache>       cache;              ///< The cache of completed instances, if any.
+        bool                                cache_traces=false; ///< Are the traces kept in the cache? Batches saving their trace are not cached otherwise.
+        uint64_t                            trace_buffer=16<<20;    ///< The default memory in bytes for the records of an instance not yet in its backup trace.
+        mutable trajectory_pool<typename model_t::delta_state_t>    trajectories;   ///< The rings of the trajectories, recycled across instances.
+        mutable std::atomic<uint64_t>       spills=0;           ///< How many times a trajectory filled its ring.
+        mutable arena_pool                  arenas;             ///< The arenas of the instances, recycled across them.
+        std::string                         model_canonical;    ///< The patched model, as canonical JSON.
+        std::string                         cache_base;         ///< The canonical prefix of the keys of all the batches.
 
         bool                                throw_wrong_type=false;
         bool                                verbose_messages=false;
@@ -187,6 +818,7 @@ struct simulator_t{
         uint                                default_backup=0;
         bool                                default_save_trace=true;
         bool                                default_save_mstate=false;
+        trace_format_t                      default_trace_format=trace_format_t::json;
 
         /**
          * @brief Helper function to process a type matching error
@@ -203,6 +835,88 @@ struct simulator_t{
             else err<<"The default value will be used and this directive is going to be skipped.\n";
         }
 
+        /**
+         * @brief A batch by its index, generating it when it is the point of a sweep.
+         * @return null if the point of a sweep is not a valid batch.
+         */
+        std::shared_ptr<const task_batch_t> _batch(uint index) const;
+
+        /**
+         * @brief The number of instances of the point of a sweep, without generating its batch.
+         */
+        uint _sweep_instances(const sweep_t& sw, uint point) const;
+
+        /**
+         * @brief Set the key of a batch in the result cache, if enabled.
+         */
+        void _prepare_cache(task_batch_t& batch) const;
+
+        /**
+         * @brief Rebuild the estimate of an adaptive batch from the final states of the instances completed by previous runs.
+         */
+        void _resume_adaptive(const task_batch_t& batch) const;
+
+        /**
+         * @brief Merge the observables of the instances completed by a previous run in the statistics of their batch.
+         */
+        void _resume_statistics(const task_batch_t& batch) const;
+
+        /**
+         * @brief Aggregate the samples logged by an instance, keeping the last one of each bin.
+         * @param log the content of its `observed` file, one JSON array `[bin,values...]` per line.
+         * @param bins only the bins below this one are kept.
+         * @param into where the samples are added.
+         * @param kept if not null, the lines of the samples kept, in the order of their bins.
+         */
+        static void _replay_observed(const std::string& log, uint64_t bins, ensemble_stats& into, std::string* kept);
+
+        /**
+         * @brief Merge the aggregates of all the workers, and write them in the workspace.
+         */
+        void _write_statistics();
+
+        /**
+         * @brief Merge the metrics of all the threads of this process, and write them in the workspace as %name.json and %name.prom. Only with SSAGI_METRICS.
+         */
+        void _write_metrics(const std::string& name) const;
+
+        /**
+         * @brief Create the status page of the workspace, with the instances already completed by previous runs accounted for.
+         */
+        void _open_status();
+
+        /**
+         * @brief Start the writer stage and the callback dispatcher, once for the run or once in each worker process.
+         */
+        void _open_stages();
+
+        /**
+         * @brief Wait for the pending writes and callbacks, report about them and stop their threads.
+         */
+        void _close_stages();
+
+        /**
+         * @brief The interface of process_queue, only used in the worker processes. run is also used by the workers of a distributed run.
+         */
+        int run(const process_job_t& job);
+        inline void worker_begin(uint){phase_metrics::reset();_open_stages();}
+        inline void worker_end(){_close_stages();_write_metrics("metrics-"+std::to_string(getpid()));}
+
+        /**
+         * @brief Run a callback, or hand it to the dispatcher when possible.
+         * @param key notifications of the same callback and key can be coalesced.
+         * @param event is it the notification of a step? Only those can be coalesced or dropped, completions are always delivered.
+         */
+        template<typename A>
+        void _notify(const callback_t& cb, uint64_t key, const A& arg, bool event) const;
+
+        /**
+         * @brief Read a file left in the workspace by a previous run, whatever its layout.
+         * @param file the path relative to the workspace.
+         * @return false if the file is not there.
+         */
+        bool _read(const std::string& file, std::string& content) const;
+
         void _missing_field(const std::string& field) const{
             err<<"Error: the field ["<<field<<"] is missing and is required. An exception will be thrown.\n";
             throw StringException("MissingFieldException");
@@ -229,8 +943,16 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
         if(it!=config.end() && it->is_string()){
             workspace=*it;
 
+            //The workers of a distributed run join the workspace of their coordinator.
+            auto it_2=config.find("distributed");
+            const bool joining=it_2!=config.end() && it_2->is_object() && it_2->value("role","")=="worker";
+
             //I need to create a directory
-            if(!continue_mode){
+            if(joining){
+                out<<"Joining the workspace in ["<<workspace<<"]\n";
+                std::filesystem::create_directories(workspace);
+            }
+            else if(!continue_mode){
                 out<<"Creating a new workspace in ["<<workspace<<"]\n";
                 if(std::filesystem::create_directories(workspace)){}
                 else{
@@ -242,6 +964,12 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
             else{
                 out<<"Resuming the workspace in ["<<workspace<<"]\n";
             }
+
+            manifest=std::make_unique<completion_manifest>(workspace+"/manifest");
+            if(continue_mode)previous=std::make_unique<packed_workspace>(workspace);
+            if(continue_mode){
+                out<<"["<<manifest->load()<<"] instances were already completed and will be skipped.\n";
+            }
         }
         else if(it!=config.end())_type_mismatch("workspace","string",false);
         else _missing_field("workspace");
@@ -284,6 +1012,10 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
 
             out<<"Model loaded.\n";
 
+            //Objects are kept sorted by nlohmann::json, so the dump is canonical.
+            model_canonical=model_json.dump();
+            this->model_json=std::move(model_json);
+
             //Save the patched model to be referred later.
 
         }
@@ -322,14 +1054,55 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
         else tweaks={};
     }
 
+    //The global seed. 0 by default.
+    {
+        auto it=config.find("seed");
+        if(it!=config.end() && it->is_number_unsigned()){
+            seed=*it;
+        }
+        else if(it!=config.end()){
+            _type_mismatch("seed","unsigned integer",true);
+        }
+        else seed=0;
+    }
+
+    //The memory for the trajectory of each instance. The default of the batches.
+    {
+        auto it=config.find("trace-buffer");
+        if(it!=config.end() && it->is_number_unsigned())trace_buffer=*it;
+        else if(it!=config.end())_type_mismatch("trace-buffer","unsigned integer",true);
+        else;
+    }
+
+    //The initial buffer of the arena of each instance.
+    {
+        auto it=config.find("arena-bytes");
+        if(it!=config.end() && it->is_number_unsigned())arenas.initial=*it;
+        else if(it!=config.end())_type_mismatch("arena-bytes","unsigned integer",true);
+        else;
+    }
+
     //Tasks!
     {
         auto it=config.find("tasks");
         if(it!=config.end() && it->is_object()){
-            //Register the task batches!
+            //Register the task batches! Those with a sweep are only expanded as they are run.
             for(auto& i:it->items()){
                 try{
-                    task_batches.emplace(i.key(),task_batch_t(*this,i.key(),i.value()));
+                    if(i.value().is_object() && i.value().contains("sweep")){
+                        sweep_t sw;
+                        sw.name=i.key();
+                        sw.points=parameter_sweep(i.value()["sweep"],seed,err);
+                        sw.base=i.value();
+                        sw.base.erase("sweep");
+                        //Each point would report its statistics on its own, and they are not kept past its instances.
+                        if(sw.base.contains("statistics")){
+                            err<<"Warning: statistics of batch ["<<sw.name<<"] are not supported in a sweep. This directive is going to be skipped.\n";
+                            sw.base.erase("statistics");
+                        }
+                        sweeps.push_back(std::move(sw));
+                    }
+                    else task_batches.emplace(i.key(),task_batch_t(*this,i.key(),i.value()));
                 }
                 catch(std::exception& e){
                     err<<"Error: "<<e.what()<<". The structure of task ["<<i.key()<<"] is not compatible. An exception will be thrown.\n";
@@ -339,6 +1112,30 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
         }
         else if(it!=config.end())_type_mismatch("tasks","map",false);
         else _missing_field("tasks");
+
+        uint index=0;
+        for(auto& [name,batch]:task_batches){
+            batch.slot=index;
+            batch.index=index++;
+        }
+        uint slot=index;
+        for(auto& sw:sweeps){
+            //The points are named after the sweep, which must not clash with the other batches.
+            for(auto& [name,batch]:task_batches){
+                if(name.starts_with(sw.name+".")){
+                    err<<"Error: the batch ["<<name<<"] has the name of a point of the sweep ["<<sw.name<<"]. An exception will be thrown.\n";
+                    throw StringException("MisformedTaskException");
+                }
+            }
+            if((uint64_t)index+sw.points.size()>std::numeric_limits<uint32_t>::max()){
+                err<<"Error: the sweep ["<<sw.name<<"] has too many points. An exception will be thrown.\n";
+                throw StringException("MisformedTaskException");
+            }
+            sw.first=index;
+            sw.slot=slot++;
+            index+=sw.points.size();
+        }
+        batch_count=index;
     }
 
     //The custom & optional tweaks field.
@@ -353,12 +1150,231 @@ simulator_t<M,C,T>::simulator_t(const nlohmann::json& config, std::ostream& _out
         else parallel_max=std::thread::hardware_concurrency();
     }
 
+    //The workspace layout. directory by default.
+    {
+        auto it=config.find("layout");
+        if(it!=config.end() && it->is_string()){
+            if(*it=="packed")packed=true;
+            else if(*it=="directory")packed=false;
+            else{
+                err<<"Error: the workspace layout ["<<it->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                throw StringException("UnsupportedLayoutException");
+            }
+        }
+        else if(it!=config.end())_type_mismatch("layout","string",true);
+        else packed=false;
+
+        it=config.find("compact");
+        if(it!=config.end() && it->is_boolean())compact=*it;
+        else if(it!=config.end())_type_mismatch("compact","boolean",true);
+        else compact=true;
+    }
+
+    //Isolation of the instances. Threads by default.
+    {
+        auto it=config.find("isolation");
+        if(it!=config.end() && it->is_string()){
+            if(*it=="process")isolated=true;
+            else if(*it=="thread")isolated=false;
+            else{
+                err<<"Error: the isolation mode ["<<it->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                throw StringException("UnsupportedIsolationException");
+            }
+        }
+        else if(it!=config.end())_type_mismatch("isolation","string",true);
+        else isolated=false;
+
+        it=config.find("retries");
+        if(it!=config.end() && it->is_number_unsigned())retries=*it;
+        else if(it!=config.end())_type_mismatch("retries","unsigned integer",true);
+        else retries=2;
+    }
+
+    //Distribution of the instances to other processes.
+    {
+        auto it=config.find("distributed");
+        if(it!=config.end() && it->is_object()){
+            auto it_2=it->find("role");
+            if(it_2!=it->end() && it_2->is_string() && (*it_2=="coordinator" || *it_2=="worker"))role=*it_2;
+            else if(it_2!=it->end()){
+                err<<"Error: the distributed role must be either [coordinator] or [worker]. An exception will be thrown.\n";
+                throw StringException("UnsupportedRoleException");
+            }
+            else _missing_field("distributed/role");
+
+            it_2=it->find("address");
+            if(it_2!=it->end() && it_2->is_string())address=*it_2;
+            else if(it_2!=it->end())_type_mismatch("distributed/address","string",false);
+            else _missing_field("distributed/address");
+
+            it_2=it->find("chunk");
+            if(it_2!=it->end() && it_2->is_number_unsigned())lease_chunk=*it_2;
+            else if(it_2!=it->end())_type_mismatch("distributed/chunk","unsigned integer",true);
+
+            it_2=it->find("lease-ms");
+            if(it_2!=it->end() && it_2->is_number_unsigned())lease_ms=*it_2;
+            else if(it_2!=it->end())_type_mismatch("distributed/lease-ms","unsigned integer",true);
+        }
+        else if(it!=config.end())_type_mismatch("distributed","object",true);
+        else;
+    }
+
+    //The live status page. Enabled by default.
+    {
+        auto it=config.find("status-page");
+        if(it!=config.end() && it->is_boolean())status_enabled=*it;
+        else if(it!=config.end())_type_mismatch("status-page","boolean",true);
+        else;
+    }
+
+    //The writer stage.
+    {
+        auto it=config.find("io");
+        if(it!=config.end() && it->is_object()){
+            auto it_2=it->find("writers");
+            if(it_2!=it->end() && it_2->is_number_unsigned())io_writers=*it_2;
+            else if(it_2!=it->end())_type_mismatch("io/writers","unsigned integer",true);
+
+            it_2=it->find("queue");
+            if(it_2!=it->end() && it_2->is_number_unsigned())io_queue=*it_2;
+            else if(it_2!=it->end())_type_mismatch("io/queue","unsigned integer",true);
+
+            it_2=it->find("durability");
+            if(it_2!=it->end() && it_2->is_string()){
+                if(!durability_from_string(*it_2,durability)){
+                    err<<"Error: the durability policy ["<<it_2->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                    throw StringException("UnsupportedDurabilityException");
+                }
+            }
+            else if(it_2!=it->end())_type_mismatch("io/durability","string",true);
+
+            it_2=it->find("group-commit-ms");
+            if(it_2!=it->end() && it_2->is_number_unsigned())group_commit_ms=*it_2;
+            else if(it_2!=it->end())_type_mismatch("io/group-commit-ms","unsigned integer",true);
+        }
+        else if(it!=config.end())_type_mismatch("io","object",true);
+        else;
+    }
+
+    //How callbacks are dispatched.
+    {
+        auto it=config.find("dispatcher");
+        if(it!=config.end() && it->is_object()){
+            auto it_2=it->find("threads");
+            if(it_2!=it->end() && it_2->is_number_unsigned())dispatcher_threads=*it_2;
+            else if(it_2!=it->end())_type_mismatch("dispatcher/threads","unsigned integer",true);
+
+            it_2=it->find("queue");
+            if(it_2!=it->end() && it_2->is_number_unsigned())dispatcher_queue=*it_2;
+            else if(it_2!=it->end())_type_mismatch("dispatcher/queue","unsigned integer",true);
+        }
+        else if(it!=config.end())_type_mismatch("dispatcher","object",true);
+        else;
+    }
+
+    //How instances are scheduled. Each one to its end by default.
+    {
+        auto it=config.find("scheduler");
+        if(it!=config.end() && it->is_object()){
+            auto it_2=it->find("mode");
+            if(it_2!=it->end() && it_2->is_string()){
+                if(*it_2=="sliced")slicing=true;
+                else if(*it_2=="queue")slicing=false;
+                else{
+                    err<<"Error: the scheduler mode ["<<it_2->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                    throw StringException("UnsupportedSchedulerException");
+                }
+            }
+            else if(it_2!=it->end())_type_mismatch("scheduler/mode","string",true);
+
+            it_2=it->find("slice-ms");
+            if(it_2!=it->end() && it_2->is_number_unsigned())slice_ms=*it_2;
+            else if(it_2!=it->end())_type_mismatch("scheduler/slice-ms","unsigned integer",true);
+
+            it_2=it->find("in-flight");
+            if(it_2!=it->end() && it_2->is_number_unsigned())in_flight=*it_2;
+            else if(it_2!=it->end())_type_mismatch("scheduler/in-flight","unsigned integer",true);
+        }
+        else if(it!=config.end())_type_mismatch("scheduler","object",true);
+        else;
+    }
+
+    if(isolated && !role.empty()){
+        err<<"Error: process isolation cannot be used in a distributed run. An exception will be thrown.\n";
+        throw StringException("UnsupportedIsolationException");
+    }
+    if(slicing && (isolated || !role.empty())){
+        err<<"Warning: the sliced scheduler is only supported with threads. This directive is going to be skipped.\n";
+        slicing=false;
+    }
+    if(isolated || !role.empty()){
+        //Each worker process has its own writer stage, and segments cannot be shared among them.
+        if(packed){
+            err<<"Error: worker processes require the directory layout. An exception will be thrown.\n";
+            throw StringException("UnsupportedIsolationException");
+        }
+        for(auto& [name,batch]:task_batches){
+            if(batch.statistics){
+                err<<"Warning: statistics of batch ["<<name<<"] are not supported with worker processes. This directive is going to be skipped.\n";
+                batch.statistics.reset();
+            }
+            //Completions are only seen by the process running them, while the parent decides what to hand out.
+            if(batch.adaptive){
+                err<<"Warning: adaptive sampling of batch ["<<name<<"] is not supported with worker processes. This directive is going to be skipped.\n";
+                batch.adaptive.reset();
+            }
+        }
+        for(auto& sw:sweeps){
+            if(sw.base.contains("adaptive")){
+                err<<"Warning: adaptive sampling of batch ["<<sw.name<<"] is not supported with worker processes. This directive is going to be skipped.\n";
+                sw.base.erase("adaptive");
+            }
+        }
+    }
+
+    //The result cache. Disabled by default.
+    {
+        auto it=config.find("cache");
+        if(it!=config.end() && it->is_object()){
+            std::string directory;
+            auto it_2=it->find("directory");
+            if(it_2!=it->end() && it_2->is_string())directory=*it_2;
+            else if(it_2!=it->end())_type_mismatch("cache/directory","string",false);
+            else _missing_field("cache/directory");
+
+            it_2=it->find("traces");
+            if(it_2!=it->end() && it_2->is_boolean())cache_traces=*it_2;
+            else if(it_2!=it->end())_type_mismatch("cache/traces","boolean",true);
+
+            if(packed){
+                err<<"Warning: the result cache requires the directory layout. This directive is going to be skipped.\n";
+            }
+            else{
+                cache=std::make_unique<result_cache>(directory);
+                auto it_3=config.find("tweaks");
+                cache_base="ssagi-result/1\n"+model_canonical+"\n"+(it_3!=config.end()?it_3->dump():"null")+"\n"+std::to_string(seed)+"\n";
+                for(auto& [name,batch]:task_batches)_prepare_cache(batch);
+            }
+        }
+        else if(it!=config.end())_type_mismatch("cache","object",true);
+        else;
+    }
+
+    //The template of a sweep is checked on its first point, so that most mistakes are found before running anything.
+    for(auto& sw:sweeps){
+        if(!_batch(sw.first)){
+            err<<"Error: the sweep ["<<sw.name<<"] does not generate valid batches. An exception will be thrown.\n";
+            throw StringException("MisformedTaskException");
+        }
+        out<<"Sweep ["<<sw.name<<"] of ["<<sw.points.size()<<"] points.\n";
+    }
+
     out<<"Configuration completed, ready to run!\n";
 
 }
 
 template<ModelType M, CallbackType C, TweaksType T>
-simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::string& _name, const nlohmann::json& config):name(_name),parent(p),initial_state(){
+simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::string& _name, const nlohmann::json& config):name(_name),parent(p),initial_state(),model(std::shared_ptr<const model_t>(),&p.model){
     //End-state! It **MUST** be defined.
     {
         auto it=config.find("end-condition");
@@ -403,16 +1419,136 @@ simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::
         else instances=p.default_instances;
     }
 
-    //Sync. 0 by default.
+    //Burn-in. None by default.
     {
-        auto it=config.find("sync");
-        if(it!=config.end() && it->is_number_unsigned()){
-            sync=*it;
-        }
-        else if(it!=config.end()){
-            p._type_mismatch("sync","unsigned integer",true);
+        auto it=config.find("burn-in");
+        if(it!=config.end() && it->is_object()){
+            burn_in=std::make_unique<burn_in_t>();
+            auto it_2=it->find("end-condition");
+            if(it_2!=it->end() && it_2->is_object()){
+                try{
+                    from_json(*it_2,burn_in->end_condition);
+                }
+                catch(std::exception& e){
+                    p.err<<"Error: "<<e.what()<<". The structure of burn-in/end-condition is not compatible. An exception will be thrown.\n";
+                    throw StringException("MisformedEndConditionException");
+                }
+            }
+            else if(it_2!=it->end())p._type_mismatch("burn-in/end-condition","object",false);
+            else p._missing_field("burn-in/end-condition");
+
+            it_2=it->find("seed");
+            if(it_2!=it->end() && it_2->is_number_unsigned())burn_in->seed=it_2->template get<uint64_t>();
+            else if(it_2!=it->end())p._type_mismatch("burn-in/seed","unsigned integer",true);
         }
-        else sync=p.default_sync;
+        else if(it!=config.end())p._type_mismatch("burn-in","object",true);
+        else;
+    }
+
+    //Statistics. None by default, and only for models with observables.
+    {
+        auto it=config.find("statistics");
+        if(it!=config.end() && it->is_object()){
+            if constexpr(ObservableModelType<model_t>){
+                statistics=std::make_unique<statistics_t>();
+                auto it_2=it->find("bin");
+                if(it_2!=it->end() && it_2->is_number_unsigned())statistics->bin=std::max(1u,it_2->template get<uint>());
+                else if(it_2!=it->end())p._type_mismatch("statistics/bin","unsigned integer",true);
+
+                it_2=it->find("quantiles");
+                if(it_2!=it->end() && it_2->is_array()){
+                    statistics->quantiles.clear();
+                    for(auto& q:*it_2){
+                        if(q.is_number() && q>=0 && q<=1)statistics->quantiles.push_back(q);
+                        else p._type_mismatch("statistics/quantiles","number in [0,1]",true);
+                    }
+                }
+                else if(it_2!=it->end())p._type_mismatch("statistics/quantiles","array",true);
+
+                it_2=it->find("accuracy");
+                if(it_2!=it->end() && it_2->is_number() && *it_2>0 && *it_2<1)statistics->accuracy=*it_2;
+                else if(it_2!=it->end())p._type_mismatch("statistics/accuracy","number in (0,1)",true);
+            }
+            else p.err<<"Warning: the model has no observables, the field [statistics] will be ignored.\n";
+        }
+        else if(it!=config.end())p._type_mismatch("statistics","object",true);
+        else;
+    }
+
+    //Sequential sampling. None by default, and only for models with observables.
+    {
+        auto it=config.find("adaptive");
+        if(it!=config.end() && it->is_object()){
+            if constexpr(ObservableModelType<model_t>){
+                uint observable=0;
+                auto it_2=it->find("observable");
+                if(it_2!=it->end() && it_2->is_string()){
+                    uint i=0;
+                    for(;i<M::observables.size() && std::string(M::observables[i])!=it_2->template get<std::string>();i++);
+                    if(i==M::observables.size()){
+                        p.err<<"Error: the model has no observable ["<<it_2->template get<std::string>()<<"]. An exception will be thrown.\n";
+                        throw StringException("UnknownObservableException");
+                    }
+                    observable=i;
+                }
+                else if(it_2!=it->end())p._type_mismatch("adaptive/observable","string",false);
+                else p._missing_field("adaptive/observable");
+
+                double width=0.05, confidence=0.95;
+                uint min_instances=10;
+                it_2=it->find("width");
+                if(it_2!=it->end() && it_2->is_number() && *it_2>0)width=*it_2;
+                else if(it_2!=it->end())p._type_mismatch("adaptive/width","positive number",true);
+
+                it_2=it->find("confidence");
+                if(it_2!=it->end() && it_2->is_number() && *it_2>0 && *it_2<1)confidence=*it_2;
+                else if(it_2!=it->end())p._type_mismatch("adaptive/confidence","number in (0,1)",true);
+
+                it_2=it->find("min-instances");
+                if(it_2!=it->end() && it_2->is_number_unsigned())min_instances=std::max(2u,it_2->template get<uint>());
+                else if(it_2!=it->end())p._type_mismatch("adaptive/min-instances","unsigned integer",true);
+
+                adaptive.reset(new adaptive_t{observable,sequential_estimate(width,confidence,min_instances)});
+            }
+            else p.err<<"Warning: the model has no observables, the field [adaptive] will be ignored.\n";
+        }
+        else if(it!=config.end())p._type_mismatch("adaptive","object",true);
+        else;
+    }
+
+    //Lanes. By default as suggested by the model, only for batched models.
+    {
+        if constexpr(BatchedDeclaredType<model_t>)static_assert(BatchedModelType<model_t,task_t>,"The model is declared as batched, but it has no call operator advancing spans of instances.");
+        if constexpr(BatchedModelType<model_t,task_t>)lanes=model_t::lanes;
+        auto it=config.find("lanes");
+        if(it!=config.end() && it->is_number_unsigned()){
+            if constexpr(BatchedModelType<model_t,task_t>)lanes=std::max(1u,it->template get<uint>());
+            else p.err<<"Warning: the model cannot advance several instances at once, the field [lanes] will be ignored.\n";
+        }
+        else if(it!=config.end()){
+            p._type_mismatch("lanes","unsigned integer",true);
+        }
+        else;
+    }
+
+    //Priority. 0 by default, only used by the sliced scheduler.
+    {
+        auto it=config.find("priority");
+        if(it!=config.end() && it->is_number_integer())priority=*it;
+        else if(it!=config.end())p._type_mismatch("priority","integer",true);
+        else;
+    }
+
+    //Sync. 0 by default.
+    {
+        auto it=config.find("sync");
+        if(it!=config.end() && it->is_number_unsigned()){
+            sync=*it;
+        }
+        else if(it!=config.end()){
+            p._type_mismatch("sync","unsigned integer",true);
+        }
+        else sync=p.default_sync;
     }
 
     //Backup. 0 by default.
@@ -427,6 +1563,56 @@ simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::
         else backup=p.default_backup;
     }
 
+    //Checkpoint policy. By default the step counters above.
+    {
+        auto it=config.find("checkpoint");
+        if(it!=config.end() && it->is_object()){
+            auto it_2=it->find("policy");
+            if(it_2!=it->end() && it_2->is_string()){
+                if(!checkpoint_policy_from_string(*it_2,checkpoint_policy)){
+                    p.err<<"Error: the checkpoint policy ["<<it_2->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                    throw StringException("UnsupportedCheckpointPolicyException");
+                }
+            }
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/policy","string",true);
+
+            it_2=it->find("interval-ms");
+            if(it_2!=it->end() && it_2->is_number_unsigned())checkpoint_interval_ms=*it_2;
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/interval-ms","unsigned integer",true);
+
+            it_2=it->find("overhead");
+            if(it_2!=it->end() && it_2->is_number() && *it_2>0 && *it_2<1)checkpoint_overhead=*it_2;
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/overhead","number in (0,1)",true);
+
+            it_2=it->find("encoding");
+            if(it_2!=it->end() && it_2->is_string()){
+                if(*it_2=="delta")delta_checkpoints=true;
+                else if(*it_2=="full")delta_checkpoints=false;
+                else{
+                    p.err<<"Error: the checkpoint encoding ["<<it_2->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                    throw StringException("UnsupportedCheckpointEncodingException");
+                }
+            }
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/encoding","string",true);
+
+            it_2=it->find("snapshot-every");
+            if(it_2!=it->end() && it_2->is_number_unsigned() && *it_2!=0)snapshot_every=*it_2;
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/snapshot-every","positive integer",true);
+
+            it_2=it->find("compress");
+            if(it_2!=it->end() && it_2->is_boolean()){
+                compress_deltas=*it_2;
+                if(compress_deltas && !delta_stream::compression()){
+                    p.err<<"Warning: this build cannot compress the checkpoints, as it was compiled without SSAGI_ZSTD. This directive is going to be skipped.\n";
+                    compress_deltas=false;
+                }
+            }
+            else if(it_2!=it->end())p._type_mismatch("checkpoint/compress","boolean",true);
+        }
+        else if(it!=config.end())p._type_mismatch("checkpoint","object",true);
+        else;
+    }
+
     //Save trace. true by default.
     {
         auto it=config.find("save-trace");
@@ -451,6 +1637,39 @@ simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::
         else save_mstate=p.default_save_mstate;
     }
 
+    //Trace format. json by default.
+    {
+        auto it=config.find("trace-format");
+        if(it!=config.end() && it->is_string()){
+            if(!trace_format_from_string(*it,trace_format)){
+                p.err<<"Error: the trace format ["<<it->template get<std::string>()<<"] is not supported. An exception will be thrown.\n";
+                throw StringException("UnsupportedTraceFormatException");
+            }
+            if constexpr(!TriviallyCopyableModelType<M>){
+                if(trace_format==trace_format_t::raw){
+                    p.err<<"Error: the raw trace format requires trivially copyable states. An exception will be thrown.\n";
+                    throw StringException("UnsupportedTraceFormatException");
+                }
+            }
+        }
+        else if(it!=config.end()){
+            p._type_mismatch("trace-format","string",true);
+        }
+        else trace_format=p.default_trace_format;
+    }
+
+    //Trace buffer. The global one by default.
+    {
+        auto it=config.find("trace-buffer");
+        if(it!=config.end() && it->is_number_unsigned()){
+            trace_buffer=*it;
+        }
+        else if(it!=config.end()){
+            p._type_mismatch("trace-buffer","unsigned integer",true);
+        }
+        else trace_buffer=p.trace_buffer;
+    }
+
     //Detect the global callback
     {
         auto it=config.find("batch-callback");
@@ -485,7 +1704,7 @@ simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::
 
     //Detect the event callback
     {
-        auto it=config.find("batch-callback");
+        auto it=config.find("event-callback");
         if(it!=config.end()){
             event_callback=callback_t();
             try{
@@ -514,178 +1733,1373 @@ simulator_t<M,C,T>::task_batch_t::task_batch_t(const simulator_t& p, const std::
         }
         else tweaks={};
     }
+
+    //What determines the results of the instances, for the result cache. Checkpoints and callbacks do not.
+    {
+        nlohmann::json tmp=nlohmann::json::object();
+        for(const char* k:{"initial-state","end-condition","tweaks","burn-in","statistics","lanes","save-trace","save-model-state","trace-format"}){
+            auto it=config.find(k);
+            if(it!=config.end())tmp[k]=*it;
+        }
+        canonical=tmp.dump();
+    }
 }
 
 template<ModelType M, CallbackType C, TweaksType T>
-simulator_t<M,C,T>::task_t::task_t(const simulator_t<M,C,T>::task_batch_t& p, uint _id):parent(p),id(_id){}
+simulator_t<M,C,T>::task_t::task_t(const simulator_t<M,C,T>::task_batch_t& p, uint _id, bool _resume):parent(p),memory(p.parent.arenas.acquire()),id(_id),resume(_resume),observation(memory->resource()){}
 
 template<ModelType M, CallbackType C, TweaksType T>
 int simulator_t<M,C,T>::operator()(){
-    workers_queue<simulator_t> queue(parallel_max);
-    queue(*this,true,true,out,err);
+    phase_metrics::reset();
+    for(auto& [name,batch]:task_batches){
+        if(batch.statistics){
+            if constexpr(ObservableModelType<M>)batch.statistics->per_worker.assign(std::max(1u,parallel_max),ensemble_stats(M::observables.size(),batch.statistics->accuracy));
+        }
+    }
+
+    if(role=="worker"){
+        //Completions are recorded by the coordinator, which owns the manifest.
+        manifest->forward=[](const std::string& line){lease_client::captured.push_back(line);};
+        _open_stages();
+        {
+            lease_client client(address,[this](const process_job_t& job){return run(job);},lease_ms);
+            workers_queue<lease_client> queue(parallel_max);
+            for(;!client.finished();)queue(client,false,true,out,err);
+        }
+        _close_stages();
+        _write_metrics("metrics-"+std::to_string(getpid()));
+        return 0;
+    }
+
+    for(auto& [name,batch]:task_batches){
+        _resume_adaptive(batch);
+        _resume_statistics(batch);
+    }
+    manifest->open_for_append(durability!=durability_t::none);
+    //Worker processes inherit the mapping, so their updates land in the same page.
+    if(status_enabled && role.empty())_open_status();
+    if(role=="coordinator"){
+        //The instances are run by the workers, the coordinator only hands them out.
+        lease_coordinator<simulator_t> queue(address,lease_chunk,lease_ms,retries);
+        queue(*this,manifest.get(),true,out,err);
+    }
+    else if(isolated){
+        //Burn-ins are run before forking, so that the workers inherit their snapshots instead of repeating them.
+        _open_stages();
+        for(auto& [name,batch]:task_batches){
+            if(batch.burn_in)std::call_once(batch.burn_in->once,[&](){batch.burn_in->snapshot=task_t::_burn_in(batch);});
+        }
+        //No thread of the simulator can be alive while forking.
+        _close_stages();
+
+        process_queue<simulator_t> queue(parallel_max,retries);
+        queue(*this,true,out,err);
+    }
+    else if(slicing){
+        _open_stages();
+        coroutine_queue<simulator_t> queue(parallel_max,in_flight);
+        //SIGUSR1 pauses the run, keeping every instance suspended in memory, and resumes it.
+        auto previous=std::signal(SIGUSR1,[](int){coroutine_queue<simulator_t>::paused.store(!coroutine_queue<simulator_t>::paused.load());});
+        queue(*this,true,out,err);
+        std::signal(SIGUSR1,previous);
+        _close_stages();
+    }
+    else{
+        _open_stages();
+        workers_queue<simulator_t> queue(parallel_max);
+        queue(*this,true,true,out,err);
+        _close_stages();
+    }
+
+    if(status.valid()){
+        status.header().finished_ns.store(status_page::now_ns(),std::memory_order_relaxed);
+        status=status_page();
+    }
+
+    for(auto& [name,batch]:task_batches){
+        if(batch.adaptive && !batch.adaptive->estimate.converged()){
+            const running_moments r=batch.adaptive->estimate.current();
+            err<<"Warning: batch ["<<name<<"] did not converge within ["<<batch.instances<<"] instances, the estimate is ["<<r.mean<<"] +- ["<<batch.adaptive->estimate.half_width(r)<<"].\n";
+        }
+    }
+
+    _write_statistics();
+    _write_metrics("metrics");
+
+    if(packed && compact){
+        out<<"Compacting the workspace segments.\n";
+        packed_workspace(workspace).compact();
+    }
     if(global_callback.has_value())global_callback.value()(*this);
     return 0;
 }
 
 template<ModelType M, CallbackType C, TweaksType T>
 int simulator_t<M,C,T>::task_t::operator()(){
-    std::string task_name=parent.name+"/"+std::to_string(id);
-    std::string dir=parent.parent.workspace+"/tasks/"+task_name;
-    std::filesystem::create_directories(dir);
-    std::ofstream out(dir+"/.out", std::ios_base::app);
-    std::ofstream err(dir+"/.err", std::ios_base::app);
+    if(_surplus())return _cancel(false);
+    if(_restore_cached())return 0;
 
-    if(!out){parent.parent.err<<"Unable to open the [out] stream for task ["+task_name+"]\n";throw StringException("OutStreamFailure");}
-    if(!err){parent.parent.err<<"Unable to open the [err] stream for task ["+task_name+"]\n";throw StringException("ErrStreamFailure");}
+    //A failure while resuming is reported like any other, or the estimate of an adaptive batch would wait for it forever.
+    try{
+        _begin();
+        _run(std::chrono::steady_clock::time_point::max());
+    }
+    catch(std::exception& e){
+        return _fail(e);
+    }
+    if(cancelled)return _cancel(true);
+
+    const int ret=_finish();
+    if(ret==0)_store_cached();
+    return ret;
+}
 
-    if(parent.parent.continue_mode){
-        std::string task_name=parent.name+"/"+std::to_string(id);
-        std::string dir=parent.parent.workspace+"/tasks/"+task_name;
+template<ModelType M, CallbackType C, TweaksType T>
+task_slice simulator_t<M,C,T>::task_t::run_sliced(std::shared_ptr<const task_batch_t> p, uint first, uint count, std::chrono::milliseconds slice){
+    if(count>1)co_return run_lanes(*p,first,count);
+
+    //The task lives in the frame of the coroutine, which is all a suspended instance takes.
+    task_t t(*p,first);
+    if(t._surplus())co_return t._cancel(false);
+    if(t._restore_cached())co_return 0;
+    try{
+        t._begin();
+    }
+    catch(std::exception& e){
+        co_return t._fail(e);
+    }
+
+    for(;;){
+        bool ended;
         try{
-            //Recover the file from the backup in folder.
+            ended=t._run(std::chrono::steady_clock::now()+slice);
+        }
+        catch(std::exception& e){
+            co_return t._fail(e);
+        }
+        if(ended)break;
+        co_await std::suspend_always{};
+        t._rebind();
+    }
+    if(t.cancelled)co_return t._cancel(true);
+
+    const int ret=t._finish();
+    if(ret==0)t._store_cached();
+    co_return ret;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_run(std::chrono::steady_clock::time_point deadline){
+    //The policy of the batch is fixed, so it is resolved once to pick the loop specialized for it.
+    const uint policy=(parent.save_trace?1:0)|(parent.event_callback.has_value()?2:0)|(observed?4:0);
+    switch(policy){
+        case 0: return _loop<false,false,false>(deadline);
+        case 1: return _loop<true,false,false>(deadline);
+        case 2: return _loop<false,true,false>(deadline);
+        case 3: return _loop<true,true,false>(deadline);
+        case 4: return _loop<false,false,true>(deadline);
+        case 5: return _loop<true,false,true>(deadline);
+        case 6: return _loop<false,true,true>(deadline);
+        default: return _loop<true,true,true>(deadline);
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_rebind(){
+    if(!live)return;
+    const status_page& page=parent.parent.status;
+    live=&page.worker(this_worker%page.header().workers);
+    live->batch.store(parent.slot,std::memory_order_relaxed);
+    live->instance.store(id,std::memory_order_relaxed);
+    live->steps.store(steps,std::memory_order_relaxed);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+template<bool TRACE, bool EVENT, bool OBSERVE>
+bool simulator_t<M,C,T>::task_t::_loop(std::chrono::steady_clock::time_point deadline){
+    auto ended=[&](){
+        phase_scope timed(phase_t::end_condition);
+        return parent.end_condition(current_state);
+    };
+
+    //The end condition is evaluated once for each state, and its result reused at the checkpoints.
+    bool done=ended();
+    for(;!done;){
+        //Checked once per checkpoint, so that a surplus instance of an adaptive batch stops within one interval.
+        if(_surplus()){cancelled=true;return true;}
+        _checkpoint();
+
+        //Between two checkpoints only the model and the end condition are left, besides what the policy asks for.
+        uint64_t next=next_sync;
+        for(;;){
+            if constexpr(OBSERVE)_observe(current_state);
+
             {
-                std::ifstream state(dir+"/status.copy");
-                nlohmann::json tmp;
-                state>>tmp;
-                from_json(tmp,current_state);
-                state.close();
+                phase_scope timed(phase_t::model);
+                if constexpr(DifferentialModelType<M>){
+                    typename M::delta_state_t tmp=(*parent.model)(current_state,model_state,*this);
+                    current_state+=tmp;
+                    if constexpr(TRACE)trajectory->push_back(tmp);
+                }
+                else if constexpr(TRACE){
+                    auto old=current_state;
+                    current_state=(*parent.model)(current_state,model_state,*this);
+                    trajectory->push_back(current_state-old);
+                }
+                else current_state=(*parent.model)(current_state,model_state,*this);
             }
 
-            //If the mstate is set as recoverable recover it as well.
-            if constexpr (model_t::recoverable){
-                if(parent.save_mstate){
-                    std::ifstream state(dir+"/mstatus.copy");
-                    nlohmann::json tmp;
-                    state>>tmp;
-                    from_json(tmp,model_state);
-                    state.close();
-                }
+            if constexpr(EVENT)parent.parent._notify(parent.event_callback.value(),id,*this,true);
+
+            ++steps;
+            if(live)live->steps.store(steps,std::memory_order_relaxed);
+            if constexpr(TRACE){
+                if(trajectory->full())_spill();
             }
+            done=ended();
+            if(done || steps==next)break;
+            if(_overdue()){next=steps;break;}
         }
-        catch(...){
-            err<<"Unable to properly process the initial state. The default one will be applied.\n";
-            current_state=parent.initial_state;
-            //model_state; Not yet decided what to do about this :). @TODO
+
+        //A slice only ends on a checkpoint, so that a suspended instance has all its progress on disk.
+        if(!done && steps==next && deadline!=std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now()>=deadline){
+            _checkpoint();
+            return false;
         }
     }
-    else{
-        current_state=parent.initial_state;
-        //model_state; Not yet decided what to do about this :). @TODO
-    }
+    return true;
+}
 
-    try{
+template<ModelType M, CallbackType C, TweaksType T>
+int simulator_t<M,C,T>::task_t::run_lanes(const task_batch_t& p, uint first, uint count, bool resume){
+    if constexpr(BatchedModelType<M,task_t>){
+        std::vector<task_t> tasks;
+        tasks.reserve(count);
+        for(uint i=0;i<count;i++){
+            //Lanes completed by a previous run, or found in the cache, are simply left out of the group.
+            if(p.parent.manifest->completed(p.name+"/"+std::to_string(first+i)))continue;
+            tasks.emplace_back(p,first+i,resume);
+            //Lanes are only left out before starting, a group always runs to its end.
+            if(tasks.back()._surplus()){tasks.back()._cancel(false);tasks.pop_back();}
+            else if(tasks.back()._restore_cached())tasks.pop_back();
+        }
+        const size_t n=tasks.size();
+        if(n==0)return 0;
+
+        //The states of the lanes are kept contiguous, and only copied back in their task when it needs them.
+        //They live in the arena of the first lane, which outlives them.
+        std::pmr::memory_resource*                  arena=tasks[0].arena();
+        std::pmr::vector<typename M::state_t>       states(n,arena);
+        std::pmr::vector<typename M::mstate_t>      mstates(n,arena);
+        std::pmr::vector<typename M::state_t>       old(arena);     //The states before the step, only for models advancing them in place.
+        std::pmr::vector<typename M::delta_state_t> deltas(arena);  //The deltas of the step, only for differential models.
+        std::pmr::vector<philox_rng>                rngs(n,arena);  //The random streams before the step.
+        std::pmr::vector<uint8_t>                   active(n,1,arena);
+        std::pmr::vector<uint8_t>                   failed(n,0,arena);
+        std::pmr::vector<const task_t*>             envs(n,arena);
+        if constexpr(DifferentialModelType<M>)deltas.resize(n);
+
+        //A failing lane is reported and left out of the group, the others go on.
+        int ret=0;
+        auto fail=[&](size_t i, const std::exception& e){
+            ret|=tasks[i]._fail(e);
+            active[i]=0;
+            failed[i]=1;
+        };
 
-        for(uint step=0;!parent.end_condition(current_state);step++){
-            if(step!=0 && (step%((parent.sync+1)*(parent.backup+1)))==0){
-                //Backup stuff
-                std::filesystem::copy(dir+"/status",dir+"/status.copy",std::filesystem::copy_options::overwrite_existing);
-                if(parent.save_mstate)std::filesystem::copy(dir+"/mstatus",dir+"/mstatus.copy",std::filesystem::copy_options::overwrite_existing);
-                if(parent.save_trace){
-                    std::ofstream trace(dir+"/trace.copy",std::ios_base::app);
-                    for(uint i=(parent.sync+1)*(parent.backup+1);i!=0;i--){
-                        nlohmann::json tmp;
-                        to_json(tmp,trajectory[trajectory.size()-i]);
-                        trace<<tmp<<(char)31;   //Divide the unit of a record.
+        for(size_t i=0;i<n;i++){
+            envs[i]=&tasks[i];
+            try{
+                tasks[i]._begin();
+            }
+            catch(std::exception& e){
+                fail(i,e);
+                continue;
+            }
+            states[i]=tasks[i].current_state;
+            mstates[i]=tasks[i].model_state;
+        }
+
+        auto publish=[&](size_t i){
+            tasks[i].current_state=states[i];
+            tasks[i].model_state=mstates[i];
+        };
+
+        auto advance=[&](size_t from, size_t lanes){
+            phase_scope timed(phase_t::model);
+            std::span<const uint8_t> a(active.data()+from,lanes);
+            std::span<const task_t* const> e(envs.data()+from,lanes);
+            if constexpr(DifferentialModelType<M>)(*p.model)(std::span(deltas).subspan(from,lanes),std::span<const typename M::state_t>(states).subspan(from,lanes),std::span(mstates).subspan(from,lanes),a,e);
+            else (*p.model)(std::span(states).subspan(from,lanes),std::span(mstates).subspan(from,lanes),a,e);
+        };
+
+        for(;;){
+            size_t alive=0;
+            for(size_t i=0;i<n;i++){
+                if(!active[i])continue;
+                task_t& t=tasks[i];
+                try{
+                    bool ended;
+                    {
+                        phase_scope timed(phase_t::end_condition);
+                        ended=p.end_condition(states[i]);
                     }
-                    trajectory.clear();
-                    trace.close();
+                    if(ended){active[i]=0;continue;}
+                    if(t._checkpoint_due() || t._overdue()){publish(i);t._checkpoint();}
+                    if(t.observed)t._observe(states[i]);
+                    alive++;
+                }
+                catch(std::exception& e){
+                    fail(i,e);
                 }
             }
-            if((step%(parent.sync+1))==0){
-                //Save the state
-                {
-                    std::ofstream status(dir+"/status");
-                    nlohmann::json tmp;
-                    to_json(tmp,current_state);
-                    status<<tmp;
-                    status.close();
+            if(alive==0)break;
+
+            if constexpr(!DifferentialModelType<M>)old=states;
+            for(size_t i=0;i<n;i++)rngs[i]=tasks[i].rng_state;
+            try{
+                advance(0,n);
+            }
+            catch(std::exception&){
+                //Which lane failed is unknown, so the step is repeated for each one on its own, from where it was.
+                for(size_t i=0;i<n;i++){
+                    if(!active[i])continue;
+                    if constexpr(!DifferentialModelType<M>)states[i]=old[i];
+                    tasks[i].rng_state=rngs[i];
                 }
-                if(parent.save_mstate){
-                    std::ofstream mstatus(dir+"/mstatus");
-                    nlohmann::json tmp;
-                    to_json(tmp,model_state);
-                    mstatus<<tmp;
-                    mstatus.close();
-                }
-                if(step!=0 && parent.save_trace){
-                    std::ofstream trace(dir+"/trace",std::ios_base::app);
-                    for(uint i=parent.sync+1;i!=0;i--){
-                        nlohmann::json tmp;
-                        to_json(tmp,trajectory[trajectory.size()-i]);
-                        trace<<tmp<<(char)31;   //Divide the unit of a record.
+                for(size_t i=0;i<n;i++){
+                    if(!active[i])continue;
+                    try{
+                        advance(i,1);
+                    }
+                    catch(std::exception& e){
+                        fail(i,e);
                     }
-                    trace.close();
                 }
             }
 
-            if constexpr(M::differential){
-                typename M::delta_state_t tmp=parent.parent.model(current_state,model_state,*this);
-                current_state+=tmp;
+            for(size_t i=0;i<n;i++){
+                if(!active[i])continue;
+                task_t& t=tasks[i];
+                try{
+                    if constexpr(DifferentialModelType<M>)states[i]+=deltas[i];
+                    t.steps++;
+                    if(t.live)t.live->steps.store(t.steps,std::memory_order_relaxed);
+                    if(p.save_trace){
+                        if constexpr(DifferentialModelType<M>)t.trajectory->push_back(deltas[i]);
+                        else t.trajectory->push_back(states[i]-old[i]);
+                        if(t.trajectory->full()){publish(i);t._spill();}
+                    }
+                    if(p.event_callback.has_value()){
+                        //Deferred callbacks do not look at the task, so there is nothing to publish for them.
+                        if constexpr(!DeferrableCallbackType<C>)publish(i);
+                        p.parent._notify(p.event_callback.value(),t.id,t,true);
+                    }
+                }
+                catch(std::exception& e){
+                    fail(i,e);
+                }
+            }
+        }
 
-                if(parent.save_trace)trajectory.push_back(tmp);
+        for(size_t i=0;i<n;i++){
+            if(failed[i])continue;
+            publish(i);
+            const int r=tasks[i]._finish();
+            if(r==0)tasks[i]._store_cached();
+            ret|=r;
+        }
+        return ret;
+    }
+    else{
+        throw StringException("UnsupportedLanesException");
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_paths(){
+    task_name=parent.name+"/"+std::to_string(id);
+    dir=parent.parent.workspace+"/tasks/"+task_name;
+    io_key=std::hash<std::string>()(task_name);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_begin(){
+    _paths();
+    _fence();
+    if(!parent.parent.packed){
+        std::filesystem::create_directories(dir);
+        if(!std::filesystem::is_directory(dir)){parent.parent.err<<"Unable to create the directory for task ["+task_name+"]\n";throw StringException("DirectoryCreationException");}
+        out.open(dir+"/.out");
+        err.open(dir+"/.err");
+        if(!out.file){parent.parent.err<<"Unable to open the [out] stream for task ["+task_name+"]\n";throw StringException("OutStreamFailure");}
+        if(!err.file){parent.parent.err<<"Unable to open the [err] stream for task ["+task_name+"]\n";throw StringException("ErrStreamFailure");}
+    }
+
+    rng_state=philox_rng(mix64(parent.parent.seed^fnv1a64(parent.name)),id);
+    if constexpr(ObservableModelType<M>){
+        if(parent.statistics)observed=std::make_unique<ensemble_stats>(M::observables.size(),parent.statistics->accuracy);
+    }
+
+    if(parent.parent.continue_mode || resume){
+        //Workspaces left by older versions, or with another layout or encoding, have no generations and resume from the backup copies.
+        //Those left by generations have checkpoint headers and no trace.copy, and their status.copy is the link of a generation which was found invalid.
+        const bool legacy=!_generational() || std::filesystem::exists(dir+"/trace.copy") || (!std::filesystem::exists(dir+"/checkpoint") && !std::filesystem::exists(dir+"/checkpoint.copy"));
+        if(_resume_generation());
+        else if(!legacy){
+            err<<"Unable to find a valid checkpoint. The default initial state will be applied.\n";
+            _start_over();
+            if(parent.save_trace && !_cut_trace("trace",0,0))err<<"Unable to align the traces left by the previous run.\n";
+        }
+        else{
+            bool restored=true;
+            try{
+                //Recover the file from the backup in folder.
+                {
+                    std::string content;
+                    if(!_read("status.copy",content))throw StringException("MissingStatusException");
+                    nlohmann::json tmp=_load("status.copy",content);
+                    if(tmp.is_object() && tmp.contains("state") && tmp.contains("step")){
+                        from_json(tmp["state"],current_state);
+                        if(tmp.contains("rng"))from_json(tmp["rng"],rng_state);
+                        steps=tmp["step"];
+                        _restore_observed(tmp);
+                    }
+                    //Status saved before the random streams were introduced.
+                    else from_json(tmp,current_state);
+                }
+
+                //If the mstate is set as recoverable recover it as well.
+                if constexpr(RecoverableModelType<M>){
+                    if(parent.save_mstate){
+                        std::string content;
+                        if(!_read("mstatus.copy",content))throw StringException("MissingStatusException");
+                        from_json(_load("mstatus.copy",content),model_state);
+                    }
+                }
             }
-            else{
-                if(parent.save_trace){
-                    auto old=current_state;
-                    current_state=parent.parent.model(current_state,model_state,*this);
-                    trajectory.push_back(current_state-old);
+            catch(...){
+                err<<"Unable to properly process the initial state. The default one will be applied.\n";
+                _start_over();
+                restored=false;
+            }
+
+            //New records are appended to the traces left by the previous run.
+            if(parent.save_trace){
+                trace_bytes=_size("trace");
+                trace_copy_bytes=_size("trace.copy");
+                //Generations keep no trace.copy, so the backup left by an older version takes the place of the trace, which is emptied when starting over.
+                if(_generational() && !_cut_trace("trace.copy",restored?trace_copy_bytes:0,restored?_size("trace.copy.idx")/sizeof(uint64_t):0)){
+                    err<<"Unable to align the traces left by the previous run.\n";
                 }
-                else current_state=parent.parent.model(current_state,model_state,*this);
             }
+        }
+    }
+    else{
+        _initial();
+    }
 
-            if(parent.event_callback.has_value())parent.event_callback.value()(*this);
+    if(parent.save_trace){
+        //Deltas holding memory of their own are only accounted for their inline size.
+        uint64_t records=parent.trace_buffer/sizeof(typename M::delta_state_t);
+        //With the steps policy the ring is emptied by each backup, or by each sync with generations, so it never holds more than the steps between two of them. One more keeps the last one from looking like a spill.
+        if(parent.checkpoint_policy==checkpoint_policy_t::steps){
+            const uint64_t period=((uint64_t)parent.sync+1)*(_generational()?1:(uint64_t)parent.backup+1);
+            if(period<records)records=period+1;
         }
+        trajectory=parent.parent.trajectories.acquire(std::max<uint64_t>(1,records));
     }
-    catch(std::exception& e){
-        err<<"Exception triggered: "<<e.what()<<"\n";
-        return 1;
+
+    planner=checkpoint_planner(parent.checkpoint_policy,parent.sync,parent.backup,parent.checkpoint_interval_ms,parent.checkpoint_overhead);
+    next_sync=planner.first(steps);
+    next_probe=planner.probe(steps);
+
+    const status_page& page=parent.parent.status;
+    if(page.valid()){
+        live=&page.worker(this_worker%page.header().workers);
+        live->batch.store(parent.slot,std::memory_order_relaxed);
+        live->instance.store(id,std::memory_order_relaxed);
+        live->steps.store(steps,std::memory_order_relaxed);
+        live->rate.store(0,std::memory_order_relaxed);
+        //An instance resumed after a crash was already taken off the queue.
+        if(!resume)page.header().queued.fetch_sub(1,std::memory_order_relaxed);
+        live_steps=steps;
+        live_ns=status_page::now_ns();
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_observe(const typename model_t::state_t& s){
+    if constexpr(ObservableModelType<M>){
+        if(steps%parent.statistics->bin!=0)return;
+        observation.resize(M::observables.size());
+        parent.model->observe(s,std::span<double>(observation));
+        observed->add(steps/parent.statistics->bin,observation);
+        json_writer w(observed_log);
+        w.begin_array().value(steps/parent.statistics->bin);
+        for(double v:observation)w.value(v);
+        w.end_array();
+        observed_log.push_back('\n');
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_restore_observed(const nlohmann::json& status){
+    if(!observed)return;
+    observed->clear();
+    observed_log.clear();
+    std::string log;
+    if(_read("observed",log)){
+        //Samples logged after the checkpoint are dropped, as are torn lines, so that the file is rewritten with those kept before appending again.
+        const uint64_t bin=parent.statistics->bin;
+        std::string kept;
+        _replay_observed(log,(steps+bin-1)/bin,*observed,&kept);
+        _write("observed",io_writer::op_t::publish,_copy(kept));
+        return;
+    }
+    //Older versions saved the aggregates in the status of each checkpoint.
+    auto it=status.find("observed");
+    if(it!=status.end())observed->restore(*it);
+    else err<<"Warning: the checkpoint has no statistics, those of the steps before it are lost.\n";
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_start_over(){
+    //An attempt to resume may have restored some of them already.
+    model_state={};
+    rng_state=philox_rng(mix64(parent.parent.seed^fnv1a64(parent.name)),id);
+    steps=0;
+    _initial();
+    if(observed){
+        observed->clear();
+        observed_log.clear();
+        _write("observed",io_writer::op_t::publish,_copy(observed_log));
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_initial(){
+    if(parent.burn_in){
+        burn_in_t& b=*parent.burn_in;
+        std::call_once(b.once,[&](){b.snapshot=_burn_in(parent);});
+        //The warm-up is shared, its states are not: the model is about to change them.
+        current_state=b.snapshot->state;
+        model_state=b.snapshot->mstate;
+    }
+    else{
+        current_state=parent.initial_state;
+        //model_state; Not yet decided what to do about this :). @TODO
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+std::shared_ptr<const typename simulator_t<M,C,T>::burn_in_t::snapshot_t> simulator_t<M,C,T>::task_t::_burn_in(const task_batch_t& p){
+    burn_in_t& b=*p.burn_in;
+    auto snap=std::make_shared<typename burn_in_t::snapshot_t>();
+    const std::string file="tasks/"+p.name+"/burn-in";
+
+    std::string content;
+    if(p.parent.continue_mode && p.parent._read(file,content)){
+        nlohmann::json tmp=nlohmann::json::parse(content);
+        from_json(tmp["state"],snap->state);
+        if constexpr(RecoverableModelType<M>){
+            if(tmp.contains("mstate"))from_json(tmp["mstate"],snap->mstate);
+        }
+        snap->steps=tmp.value("step",(uint64_t)0);
+        return snap;
+    }
+
+    //The warm-up has its own random stream, which no instance can share.
+    task_t env(p,0);
+    env.task_name=p.name+"/burn-in";
+    env.rng_state=philox_rng(mix64(b.seed.value_or(p.parent.seed)^fnv1a64(p.name)),std::numeric_limits<uint64_t>::max());
+    env.current_state=p.initial_state;
+    for(;!b.end_condition(env.current_state);env.steps++){
+        if constexpr(DifferentialModelType<M>)env.current_state+=(*p.model)(env.current_state,env.model_state,env);
+        else env.current_state=(*p.model)(env.current_state,env.model_state,env);
+    }
+    snap->state=std::move(env.current_state);
+    snap->mstate=std::move(env.model_state);
+    snap->steps=env.steps;
+
+    nlohmann::json tmp;
+    to_json(tmp["state"],snap->state);
+    to_json(tmp["mstate"],snap->mstate);
+    tmp["step"]=snap->steps;
+    if(!p.parent.packed)std::filesystem::create_directories(p.parent.workspace+"/tasks/"+p.name);
+    p.parent.io->submit(std::hash<std::string>()(file),io_writer::op_t::write,p.parent.workspace+"/"+file,tmp.dump());
+
+    p.parent.out<<"Burn-in of ["<<p.name<<"] completed in ["<<snap->steps<<"] steps.\n";
+    return snap;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_checkpoint_due() const{
+    return steps>=next_sync;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_overdue(){
+    if(steps<next_probe)return false;
+    next_probe=planner.probe(steps);
+    if(!planner.overdue())return false;
+    next_sync=steps;
+    return true;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_checkpoint(){
+    if(!_checkpoint_due())return;
+    _fence();
+    phase_metrics::count(counter_t::checkpoints);
+    _published();
+    planner.begin();
+    _sync();
+    //The backup is taken after the sync, so that the copies are all consistent with the same step.
+    if(planner.backup_due(steps))_backup();
+    next_sync=planner.end(steps);
+    next_probe=planner.probe(steps);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_spill(){
+    //The trace alone cannot take the records, as its backup must stay consistent with the backup of the state.
+    _fence();
+    parent.parent.spills.fetch_add(1,std::memory_order_relaxed);
+    phase_metrics::count(counter_t::checkpoints);
+    _published();
+    _sync();
+    _backup();
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_published(){
+    if(!live)return;
+    const uint64_t now=status_page::now_ns();
+    if(now>live_ns && steps>live_steps)live->rate.store((steps-live_steps)*1e9/(now-live_ns),std::memory_order_relaxed);
+    live->updated_ns.store(now,std::memory_order_relaxed);
+    parent.parent.status.header().updated_ns.store(now,std::memory_order_relaxed);
+    live_steps=steps;
+    live_ns=now;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+int simulator_t<M,C,T>::task_t::_fail(const std::exception& e){
+    //Another worker may be running the instance by now, nothing of this attempt can be written.
+    if(!lease_client::holds())return 1;
+    err<<"Exception triggered: "<<e.what()<<"\n";
+    _flush_streams();
+    parent.parent.io->sync(io_key);
+    parent.parent.manifest->record(task_name,1,steps,fnv1a64(status_buffer));
+    if(live){
+        _published();
+        live->failed.fetch_add(1,std::memory_order_relaxed);
+        live->instance.store(status_page::idle,std::memory_order_relaxed);
+        parent.parent.status.header().failed.fetch_add(1,std::memory_order_relaxed);
+    }
+    //The samples of the instances after it are no longer held back, and may make the batch converge.
+    if(_sample(true) && parent.batch_callback.has_value())parent.parent._notify(parent.batch_callback.value(),0,parent,false);
+    return 1;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+int simulator_t<M,C,T>::task_t::_finish(){
+    if(!lease_client::holds())return 1;
+    //The last state is sampled before the final save, so that the status of a completed instance holds all its observables.
+    if(observed)_observe(current_state);
+
+    //Execute the final save task, and backup the last copies for restart. They are left in full, as other runs and tools read them.
+    snapshot_due=true;
+    _sync();
+    _backup();
+    _flush_streams();
+
+    //Only completed instances contribute to the statistics of the batch.
+    if(observed)parent.statistics->per_worker[this_worker].merge(*observed);
+
+    //Callbacks may look at the files of this task, and the manifest must not claim files which are not there yet.
+    parent.parent.io->sync(io_key);
+    parent.parent.manifest->record(task_name,0,steps,fnv1a64(status_buffer));
+    if(live){
+        _published();
+        live->completed.fetch_add(1,std::memory_order_relaxed);
+        live->instance.store(status_page::idle,std::memory_order_relaxed);
+        parent.parent.status.header().completed.fetch_add(1,std::memory_order_relaxed);
+    }
+
+    _completed_callbacks(_sample());
+    return 0;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_completed_callbacks(bool converged){
+    if(parent.instance_callback.has_value())parent.parent._notify(parent.instance_callback.value(),id,*this,false);
+    //An adaptive batch is over once it converges, and then its instance 0 may never run.
+    const bool over=parent.adaptive?(converged || (id==0 && !parent.adaptive->estimate.converged())):id==0;
+    if(over){
+        if(parent.batch_callback.has_value())parent.parent._notify(parent.batch_callback.value(),0,parent,false);
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_sample(bool failed){
+    if constexpr(ObservableModelType<M>){
+        if(!parent.adaptive)return false;
+        running_moments r;
+        if(failed){
+            if(!parent.adaptive->estimate.skip(id,r))return false;
+        }
+        else{
+            observation.resize(M::observables.size());
+            parent.model->observe(current_state,std::span<double>(observation));
+            if(!parent.adaptive->estimate.add(id,observation[parent.adaptive->observable],r))return false;
+        }
+        parent.parent.out<<"Batch ["<<parent.name<<"] converged after ["<<r.count<<"] instances, ["<<M::observables[parent.adaptive->observable]<<"] is ["<<r.mean<<"] +- ["<<parent.adaptive->estimate.half_width(r)<<"].\n";
+        return true;
+    }
+    return false;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+int simulator_t<M,C,T>::task_t::_cancel(bool started){
+    const status_page& page=parent.parent.status;
+    if(started){
+        //Its checkpoints are left in place, it would simply resume if a later run needed it.
+        err<<"Stopped at step ["<<steps<<"], the batch has converged.\n";
+        _flush_streams();
+        if(live)live->instance.store(status_page::idle,std::memory_order_relaxed);
+    }
+    else if(page.valid())page.header().queued.fetch_sub(1,std::memory_order_relaxed);
+    if(page.valid())page.header().total.fetch_sub(1,std::memory_order_relaxed);
+    return 0;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_restore_cached(){
+    result_cache* cache=parent.parent.cache.get();
+    //Instances resumed after a crash have already been looked up.
+    if(cache==nullptr || !parent.cached || resume)return false;
+
+    _paths();
+    cache_key=result_cache::digest(parent.cache_prefix+"\n"+std::to_string(id));
+    auto result=cache->lookup(cache_key);
+    if(!result)return false;
+
+    //An entry which cannot be used is simulated again and replaced, without leaving any of its files behind to be appended to.
+    auto discard=[&](){
+        cache->evict(cache_key);
+        std::error_code ec;
+        for(auto& f:std::filesystem::directory_iterator(dir,ec))std::filesystem::remove(f.path(),ec);
+        return false;
+    };
+
+    std::filesystem::create_directories(dir);
+    std::string content;
+    if(!cache->materialize(cache_key,dir) || !_read("status",content))return discard();
+    const uint64_t checksum=fnv1a64(content);
+    if(to_hex(checksum)!=result->value("checksum",""))return discard();
+
+    try{
+        nlohmann::json tmp=nlohmann::json::parse(content);
+        from_json(tmp["state"],current_state);
+        steps=result->value("step",(uint64_t)0);
+        if constexpr(ObservableModelType<M>){
+            if(parent.statistics && result->contains("observed")){
+                ensemble_stats o(M::observables.size(),parent.statistics->accuracy);
+                o.restore((*result)["observed"]);
+                parent.statistics->per_worker[this_worker].merge(o);
+            }
+        }
+    }
+    catch(...){
+        return discard();
+    }
+
+    parent.parent.manifest->record(task_name,0,steps,checksum);
+    const status_page& page=parent.parent.status;
+    if(page.valid()){
+        page.header().queued.fetch_sub(1,std::memory_order_relaxed);
+        page.header().completed.fetch_add(1,std::memory_order_relaxed);
     }
+    _completed_callbacks(_sample());
+    return true;
+}
 
-    //Execute the final save task.
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_store_cached(){
+    result_cache* cache=parent.parent.cache.get();
+    if(cache==nullptr || !parent.cached || cache_key.empty())return;
+
+    nlohmann::json result;
+    result["step"]=steps;
+    result["checksum"]=to_hex(fnv1a64(status_buffer));
+    if(observed)result["observed"]=observed->save();
+    cache->store(cache_key,dir,result);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_sync(){
+    //Both buffers keep their capacity across syncs, so once warm they are written without allocating.
     {
-        //Save all
         {
-            std::ofstream status(dir+"/status");
-            nlohmann::json tmp;
-            to_json(tmp,current_state);
-            status<<tmp;
-            status.close();
+            phase_scope timed(phase_t::serialize);
+            status_buffer.clear();
+            json_writer w(status_buffer);
+            w.begin_object().key("state");
+            write_json(w,current_state);
+            w.key("step").value(steps);
+            if constexpr(RandomizedModelType<M>){
+                w.key("rng");
+                write_json(w,rng_state);
+            }
+            w.end_object();
         }
-        if(parent.save_mstate){
-            std::ofstream mstatus(dir+"/mstatus");
-            nlohmann::json tmp;
-            to_json(tmp,model_state);
-            mstatus<<tmp;
-            mstatus.close();
+        _save("status",status_buffer,status_delta);
+    }
+    if(parent.save_mstate){
+        {
+            phase_scope timed(phase_t::serialize);
+            mstatus_buffer.clear();
+            json_writer w(mstatus_buffer);
+            write_json(w,model_state);
         }
-        if(parent.save_trace){
-            std::ofstream trace(dir+"/trace",std::ios_base::app);
-            for(auto& t:trajectory){
-                nlohmann::json tmp;
-                to_json(tmp,t);
-                trace<<tmp<<(char)31;   //Divide the unit of a record.
+        _save("mstatus",mstatus_buffer,mstatus_delta);
+    }
+    snapshot_due=false;
+    //Only the samples since the previous sync are written, so that a resumed instance replays them instead of each checkpoint saving all its aggregates.
+    if(!observed_log.empty()){
+        phase_scope timed(phase_t::submit);
+        _write("observed",io_writer::op_t::append,_copy(observed_log));
+        observed_log.clear();
+    }
+    if(out.pending() || err.pending())_flush_streams();
+    if(parent.save_trace){
+        _append_trace("trace",trace_bytes,synced,trajectory->size());
+        trace_records+=trajectory->size()-synced;
+        synced=trajectory->size();
+        //Generations have no trace.copy to write the records in again, their backup is a prefix of the trace.
+        if(_generational()){
+            trajectory->clear();
+            synced=0;
+        }
+    }
+
+    //The header goes last, so that a generation is only published once all its files are written.
+    if(_generational()){
+        generation++;
+        char hex[17];
+        std::string header=parent.parent.io->acquire(io_key);
+        {
+            json_writer w(header);
+            w.begin_object().key("generation").value(generation).key("step").value(steps);
+            w.key("status").value(to_hex(fnv1a64(status_buffer),hex));
+            if(parent.save_mstate)w.key("mstatus").value(to_hex(fnv1a64(mstatus_buffer),hex));
+            if(parent.save_trace)w.key("trace").value(trace_bytes).key("records").value(trace_records);
+            w.end_object();
+        }
+        phase_scope timed(phase_t::submit);
+        _write("checkpoint",io_writer::op_t::publish,std::move(header));
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_save(const std::string& file, const std::string& buffer, delta_stream& stream){
+    if(!parent.delta_checkpoints){
+        phase_scope timed(phase_t::submit);
+        _write(file,io_writer::op_t::publish,_copy(buffer));
+        return;
+    }
+    bool snapshot;
+    {
+        phase_scope timed(phase_t::serialize);
+        snapshot=stream.sync(buffer,parent.snapshot_every,snapshot_due,parent.compress_deltas);
+    }
+    phase_scope timed(phase_t::submit);
+    if(snapshot){
+        _write(file,io_writer::op_t::publish,_copy(buffer));
+        _write(file+".delta",io_writer::op_t::write,{});
+    }
+    else _write(file+".delta",io_writer::op_t::append,_copy(stream.record()));
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_save_copy(const std::string& file, const std::string& buffer, delta_stream& stream){
+    //Published files are never written in place, so the backup is just another name for the last generation.
+    if(_generational()){
+        _link(file+".copy",file);
+        return;
+    }
+    if(!parent.delta_checkpoints){
+        _write(file+".copy",io_writer::op_t::write,_copy(buffer));
+        return;
+    }
+    //Until the snapshot changes, a backup only appends the patch of the last sync.
+    if(stream.backup_base()){
+        //The file still holds the snapshot, as it is only replaced by the next one: the copy becomes another name for it.
+        //Packed workspaces publish every file through their index, so there the copy is simply written.
+        if(parent.parent.packed)_write(file+".copy",io_writer::op_t::write,_copy(stream.base()));
+        else _link(file+".copy",file);
+        _write(file+".copy.delta",io_writer::op_t::publish,_copy(stream.record()));
+    }
+    else _write(file+".copy.delta",io_writer::op_t::append,_copy(stream.record()));
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_resume_generation(){
+    if(!_generational())return false;
+    for(const std::string suffix:{"",".copy"}){
+        try{
+            std::string content;
+            if(!_read("checkpoint"+suffix,content))continue;
+            nlohmann::json header=nlohmann::json::parse(content);
+
+            //A generation is valid only if all its files are those it published.
+            std::string status;
+            if(!_read("status"+suffix,status) || to_hex(fnv1a64(status))!=header.at("status").template get<std::string>())continue;
+            std::string mstatus;
+            if constexpr(RecoverableModelType<M>){
+                if(parent.save_mstate){
+                    if(!header.contains("mstatus") || !_read("mstatus"+suffix,mstatus) || to_hex(fnv1a64(mstatus))!=header["mstatus"].template get<std::string>())continue;
+                }
+            }
+            const uint64_t bytes=header.value("trace",(uint64_t)0);
+            const uint64_t records=header.value("records",(uint64_t)0);
+            if(parent.save_trace){
+                if(_size("trace")<bytes)continue;
+                if(parent.trace_format!=trace_format_t::json && _size("trace.idx")<records*sizeof(uint64_t))continue;
             }
-            trace.close();
+
+            nlohmann::json tmp=nlohmann::json::parse(status);
+            from_json(tmp["state"],current_state);
+            if(tmp.contains("rng"))from_json(tmp["rng"],rng_state);
+            steps=tmp["step"];
+            _restore_observed(tmp);
+            if constexpr(RecoverableModelType<M>){
+                if(parent.save_mstate)from_json(nlohmann::json::parse(mstatus),model_state);
+            }
+            generation=header.value("generation",(uint64_t)0);
+            if(parent.save_trace && !_cut_trace("trace",bytes,records))continue;
+            return true;
         }
+        catch(...){
+            continue;
+        }
+    }
+    return false;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_cut_trace(const std::string& from, uint64_t bytes, uint64_t records){
+    //Nothing is copied: the kept trace is renamed when needed, and truncated.
+    auto cut=[&](const std::string& suffix, uint64_t size){
+        const std::string source=dir+"/"+from+suffix;
+        const std::string target=dir+"/trace"+suffix;
+        std::error_code ec;
+        if(source!=target && std::filesystem::exists(source,ec))std::filesystem::rename(source,target,ec);
+        if(!ec && !std::filesystem::exists(target,ec))std::ofstream(target,std::ios_base::binary);
+        if(!ec)std::filesystem::resize_file(target,size,ec);
+        //A trace.copy left by an older version would only be stale from now on.
+        if(!ec)std::filesystem::remove(dir+"/trace.copy"+suffix,ec);
+        return !ec;
+    };
+    if(!cut("",bytes))return false;
+    if(parent.trace_format!=trace_format_t::json && !cut(".idx",records*sizeof(uint64_t)))return false;
+    trace_bytes=bytes;
+    trace_copy_bytes=0;
+    trace_records=records;
+    return true;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+nlohmann::json simulator_t<M,C,T>::task_t::_load(const std::string& file, const std::string& content) const{
+    //Checkpoints left by a run with delta checkpoints are replayed, whatever the encoding of this one.
+    std::string log;
+    if(_read(file+".delta",log))return delta_stream::replay(content,log);
+    return nlohmann::json::parse(content);
+}
 
-        //Backup the last copies for restart.
-        std::filesystem::copy(dir+"/status",dir+"/status.copy",std::filesystem::copy_options::overwrite_existing);
-        if(parent.save_mstate)std::filesystem::copy(dir+"/mstatus",dir+"/mstatus.copy",std::filesystem::copy_options::overwrite_existing);
-        if(parent.save_trace){
-            std::ofstream trace(dir+"/trace.copy",std::ios_base::app);
-            for(auto& t:trajectory){
-                nlohmann::json tmp;
-                to_json(tmp,t);
-                trace<<tmp<<(char)31;   //Divide the unit of a record.
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_backup(){
+    phase_scope timed(phase_t::backup);
+    //The copies are written from the buffers of the last sync, there is no need to read the files back.
+    _save_copy("status",status_buffer,status_delta);
+    if(parent.save_mstate)_save_copy("mstatus",mstatus_buffer,mstatus_delta);
+    if(parent.save_trace){
+        if(!_generational())_append_trace("trace.copy",trace_copy_bytes,0,trajectory->size());
+        trajectory->clear();
+        synced=0;
+    }
+    if(_generational())_link("checkpoint.copy","checkpoint");
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::task_t::_read(const std::string& file, std::string& content) const{
+    return parent.parent._read("tasks/"+task_name+"/"+file,content);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_open_stages(){
+    io=std::make_unique<io_writer>(io_writers,io_queue,durability,group_commit_ms,workspace,previous?previous->next_run():0,packed);
+    //The writes queued by a worker are dropped once its leases could have been given to another one.
+    if(role=="worker")io->fence=[](){return lease_client::holds();};
+    if constexpr(DeferrableCallbackType<C>)dispatcher=std::make_unique<callback_dispatcher>(dispatcher_threads,dispatcher_queue);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_close_stages(){
+    io->drain();
+    if(io->errors()!=0)err<<"Warning: ["<<io->errors()<<"] writes have failed.\n";
+    if(io->fenced()!=0)err<<"Warning: ["<<io->fenced()<<"] writes were dropped, as the leases of their instances had expired.\n";
+    io.reset();
+
+    if(dispatcher){
+        dispatcher->drain();
+        if(dispatcher->dispatched()+dispatcher->coalesced()+dispatcher->dropped()+dispatcher->failed()!=0)out<<"Callbacks: ["<<dispatcher->dispatched()<<"] dispatched, ["<<dispatcher->coalesced()<<"] coalesced, ["<<dispatcher->dropped()<<"] dropped, ["<<dispatcher->waited()<<"] completions waited for room.\n";
+        if(dispatcher->failed()!=0)err<<"Warning: ["<<dispatcher->failed()<<"] callbacks have failed.\n";
+        dispatcher.reset();
+    }
+
+    if(spills!=0)out<<"Trajectories: ["<<spills<<"] extra backups as their buffers were full.\n";
+
+    auto peaks=arenas.peaks();
+    if(!peaks.empty()){
+        out<<"Arenas: peak of [";
+        for(size_t i=0;i<peaks.size();i++)out<<(i==0?"":", ")<<peaks[i];
+        out<<"] bytes by worker.\n";
+    }
+
+    if(cache && cache->hits()+cache->misses()!=0){
+        out<<"Cache: ["<<cache->hits()<<"] hits, ["<<cache->misses()<<"] misses, ["<<cache->stored()<<"] stored.\n";
+        if(cache->failures()!=0)err<<"Warning: ["<<cache->failures()<<"] results could not be stored in the cache.\n";
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+int simulator_t<M,C,T>::run(const process_job_t& job){
+    auto batch=_batch(job.batch);
+    if(!batch)return 1;
+    //Jobs whose worker crashed resume from the last backup they left.
+    const bool resume=job.attempt!=0;
+    if(job.count>1)return task_t::run_lanes(*batch,job.first,job.count,resume);
+    task_t tmp(*batch,job.first,resume);
+    return tmp();
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+std::shared_ptr<const typename simulator_t<M,C,T>::task_batch_t> simulator_t<M,C,T>::_batch(uint index) const{
+    //The other batches live as long as the simulator, they are only pointed to.
+    if(index<task_batches.size())return std::shared_ptr<const task_batch_t>(std::shared_ptr<const task_batch_t>(),&std::next(task_batches.begin(),index)->second);
+
+    const sweep_t* sw=nullptr;
+    for(auto& i:sweeps){
+        if(index>=i.first && index<i.first+i.points.size()){sw=&i;break;}
+    }
+    if(sw==nullptr)return nullptr;
+    const uint point=index-sw->first;
+
+    std::lock_guard<std::mutex> lock(sweep_m);
+    if(last_point && last_point->index==index)return last_point;
+
+    try{
+        //The axes are set in the template with the whole model merged in, so that their pointers can reach into the arrays of both.
+        nlohmann::json config=sw->base;
+        nlohmann::json tmp=model_json;
+        auto it=config.find("model");
+        if(it!=config.end())tmp.merge_patch(*it);
+        config["model"]=std::move(tmp);
+        sw->points.apply(point,config);
+        tmp=std::move(config["model"]);
+        config.erase("model");
+
+        //Points which do not change the model share the one of the simulator, the others share theirs as long as any of them is alive.
+        std::shared_ptr<const model_t> patched;
+        std::string patched_canonical;
+        if(tmp!=model_json){
+            patched_canonical=tmp.dump();
+
+            patched=sweep_models[patched_canonical].lock();
+            if(!patched){
+                auto m=std::make_shared<model_t>();
+                from_json(tmp,*m);
+                patched=m;
+                std::erase_if(sweep_models,[](auto& i){return i.second.expired();});
+                sweep_models[patched_canonical]=patched;
+            }
+        }
+
+        auto batch=std::make_shared<task_batch_t>(*this,sw->name+"."+std::to_string(point),config);
+        if(patched){
+            batch->model=patched;
+            batch->canonical+="\n"+patched_canonical;
+        }
+        batch->statistics.reset();
+        batch->index=index;
+        batch->slot=sw->slot;
+        if(isolated || !role.empty())batch->adaptive.reset();
+        _prepare_cache(*batch);
+        _resume_adaptive(*batch);
+        last_point=batch;
+        return batch;
+    }
+    catch(std::exception& e){
+        err<<"Warning: the point ["<<point<<"] of sweep ["<<sw->name<<"] is not a valid batch ("<<e.what()<<"). This directive is going to be skipped.\n";
+        return nullptr;
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+uint simulator_t<M,C,T>::_sweep_instances(const sweep_t& sw, uint point) const{
+    //Only the values of the point are computed, the batch is never generated.
+    nlohmann::json instances=sw.points.value(point,nlohmann::json::json_pointer("/instances"));
+    if(instances.is_number_unsigned())return instances;
+    auto it_2=sw.base.find("instances");
+    if(it_2!=sw.base.end() && it_2->is_number_unsigned())return *it_2;
+    return default_instances;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_resume_adaptive(const task_batch_t& batch) const{
+    if constexpr(ObservableModelType<M>){
+        if(!batch.adaptive || !continue_mode)return;
+        std::vector<double> values(M::observables.size());
+        for(uint i=0;i<batch.instances;i++){
+            const std::string name=batch.name+"/"+std::to_string(i);
+            std::string content;
+            if(!manifest->completed(name))continue;
+            //A completed instance whose final state cannot be read is not run again, so it must not hold back those after it.
+            running_moments r;
+            bool converged;
+            try{
+                if(!_read("tasks/"+name+"/status",content))throw StringException("StatusReadException");
+                typename M::state_t state;
+                from_json(nlohmann::json::parse(content)["state"],state);
+                batch.model->observe(state,std::span<double>(values));
+                converged=batch.adaptive->estimate.add(i,values[batch.adaptive->observable],r);
+            }
+            catch(...){
+                converged=batch.adaptive->estimate.skip(i,r);
             }
-            trajectory.clear();
-            trace.close();
+            if(converged)out<<"Batch ["<<batch.name<<"] had already converged after ["<<r.count<<"] instances.\n";
         }
     }
+}
 
-    if(parent.instance_callback.has_value())parent.instance_callback.value()(*this);
-    if(id==0){
-        if(parent.batch_callback.has_value())parent.batch_callback.value()(parent);
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_resume_statistics(const task_batch_t& batch) const{
+    if constexpr(ObservableModelType<M>){
+        if(!batch.statistics || !continue_mode)return;
+        uint missing=0;
+        for(uint i=0;i<batch.instances;i++){
+            const std::string name=batch.name+"/"+std::to_string(i);
+            if(!manifest->completed(name))continue;
+            std::string content;
+            try{
+                ensemble_stats o(M::observables.size(),batch.statistics->accuracy);
+                if(_read("tasks/"+name+"/observed",content))_replay_observed(content,std::numeric_limits<uint64_t>::max(),o,nullptr);
+                else{
+                    //Older versions saved the aggregates in the final status.
+                    if(!_read("tasks/"+name+"/status",content))throw StringException("MissingStatusException");
+                    nlohmann::json status=nlohmann::json::parse(content);
+                    if(!status.contains("observed"))throw StringException("MissingStatisticsException");
+                    o.restore(status["observed"]);
+                }
+                batch.statistics->per_worker[0].merge(o);
+            }
+            catch(...){
+                missing++;
+            }
+        }
+        if(missing!=0)err<<"Warning: ["<<missing<<"] instances of batch ["<<batch.name<<"] were completed without statistics, they are not part of them.\n";
     }
-    return 0;
-}
\ No newline at end of file
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_replay_observed(const std::string& log, uint64_t bins, ensemble_stats& into, std::string* kept){
+    std::map<uint64_t,std::vector<double>> samples;
+    std::istringstream in(log);
+    for(std::string line;std::getline(in,line);){
+        try{
+            nlohmann::json j=nlohmann::json::parse(line);
+            if(!j.is_array() || j.size()!=into.size()+1)continue;
+            const uint64_t bin=j[0];
+            if(bin>=bins)continue;
+            //Values without a JSON representation were written as null.
+            auto& values=samples[bin];
+            values.resize(j.size());
+            for(size_t i=1;i<j.size();i++)values[i]=j[i].is_number()?j[i].get<double>():std::numeric_limits<double>::quiet_NaN();
+        }
+        catch(...){}
+    }
+    for(auto& [bin,values]:samples){
+        into.add(bin,std::span<const double>(values).subspan(1));
+        if(kept){
+            json_writer w(*kept);
+            w.begin_array().value(bin);
+            for(size_t i=1;i<values.size();i++)w.value(values[i]);
+            w.end_array();
+            kept->push_back('\n');
+        }
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_prepare_cache(task_batch_t& batch) const{
+    if(!cache)return;
+    batch.cached=cache_traces || !batch.save_trace;
+    batch.cache_prefix=result_cache::digest(cache_base+batch.name+"\n"+batch.canonical);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+template<typename A>
+void simulator_t<M,C,T>::_notify(const callback_t& cb, uint64_t key, const A& arg, bool event) const{
+    if constexpr(DeferrableCallbackType<C>){
+        if(dispatcher){
+            //The job is only built when it is not coalesced with a pending one, as events are notified at every step.
+            if(event)dispatcher->post(mix64((uint64_t)(uintptr_t)&cb)^key,cb.min_interval(),[&cb](){return cb.deferred();});
+            else dispatcher->deliver(cb.deferred());
+            return;
+        }
+    }
+    phase_scope timed(phase_t::callback);
+    cb(arg);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_write_statistics(){
+    if constexpr(ObservableModelType<M>){
+        for(auto& [name,batch]:task_batches){
+            if(!batch.statistics)continue;
+            ensemble_stats total(M::observables.size(),batch.statistics->accuracy);
+            for(auto& w:batch.statistics->per_worker)total.merge(w);
+            batch.statistics->per_worker.clear();
+
+            std::vector<std::string> names(M::observables.begin(),M::observables.end());
+            std::filesystem::create_directories(workspace+"/statistics");
+            std::ofstream file(workspace+"/statistics/"+name+".json");
+            file<<total.report(names,batch.statistics->bin,batch.statistics->quantiles);
+            file.close();
+        }
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_write_metrics(const std::string& name) const{
+    if constexpr(phase_metrics::enabled){
+        std::ofstream json(workspace+"/"+name+".json");
+        json<<phase_metrics::report().dump(4);
+        json.close();
+        std::ofstream prom(workspace+"/"+name+".prom");
+        prom<<phase_metrics::prometheus();
+        prom.close();
+    }
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::_open_status(){
+    std::vector<std::pair<std::string,uint64_t>> batches;
+    uint64_t done=0;
+    for(auto& [name,batch]:task_batches){
+        batches.push_back({name,batch.instances});
+        if(continue_mode){
+            for(uint i=0;i<batch.instances;i++)done+=manifest->completed(name+"/"+std::to_string(i))?1:0;
+        }
+    }
+    //A sweep is a single batch of the page, or the page would grow with its points.
+    for(auto& sw:sweeps){
+        uint64_t total=0;
+        for(uint p=0;p<sw.points.size();p++){
+            const uint n=_sweep_instances(sw,p);
+            total+=n;
+            if(continue_mode){
+                const std::string name=sw.name+"."+std::to_string(p)+"/";
+                for(uint i=0;i<n;i++)done+=manifest->completed(name+std::to_string(i))?1:0;
+            }
+        }
+        batches.push_back({sw.name,total});
+    }
+    try{
+        status=status_page::create(workspace+"/status.page",std::max(1u,parallel_max),batches);
+    }
+    catch(std::exception& e){
+        err<<"Warning: unable to create the status page of the workspace. The progress will not be published.\n";
+        return;
+    }
+    status.header().completed.store(done,std::memory_order_relaxed);
+    status.header().queued.fetch_sub(done,std::memory_order_relaxed);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+bool simulator_t<M,C,T>::_read(const std::string& file, std::string& content) const{
+    if(packed){
+        if(!previous || !previous->exists(file))return false;
+        content=previous->read(file);
+        return true;
+    }
+    std::ifstream in(workspace+"/"+file,std::ios_base::binary);
+    if(!in)return false;
+    phase_metrics::count(counter_t::files_opened);
+    content.assign(std::istreambuf_iterator<char>(in),std::istreambuf_iterator<char>());
+    return true;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+uint64_t simulator_t<M,C,T>::task_t::_size(const std::string& file) const{
+    if(parent.parent.packed)return parent.parent.previous->size("tasks/"+task_name+"/"+file);
+    return std::filesystem::exists(dir+"/"+file)?std::filesystem::file_size(dir+"/"+file):0;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_flush_streams(){
+    //In the directory layout the streams are already in their files.
+    if(!parent.parent.packed)return;
+    //The files are still created when empty, as in the directory layout they always are.
+    _write(".out",io_writer::op_t::append,out.buffer.str());
+    _write(".err",io_writer::op_t::append,err.buffer.str());
+    out.buffer.str("");
+    err.buffer.str("");
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_write(std::string_view file, io_writer::op_t op, std::string buffer) const{
+    path_buffer.assign(dir).append(1,'/').append(file);
+    parent.parent.io->submit(io_key,op,path_buffer,std::move(buffer));
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_link(std::string_view file, std::string_view target) const{
+    path_buffer.assign(dir).append(1,'/').append(file);
+    target_buffer.assign(dir).append(1,'/').append(target);
+    parent.parent.io->link(io_key,path_buffer,target_buffer);
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+std::string simulator_t<M,C,T>::task_t::_copy(const std::string& buffer) const{
+    std::string ret=parent.parent.io->acquire(io_key);
+    ret.assign(buffer);
+    return ret;
+}
+
+template<ModelType M, CallbackType C, TweaksType T>
+void simulator_t<M,C,T>::task_t::_append_trace(const std::string& file, uint64_t& size, uint from, uint to) const{
+    if(from>=to)return;
+
+    std::string buffer=parent.parent.io->acquire(io_key);
+    std::string index=parent.parent.io->acquire(io_key);
+    const bool indexed=parent.trace_format!=trace_format_t::json;
+
+    {
+        phase_scope timed(phase_t::serialize);
+        for(uint i=from;i<to;i++){
+            if(indexed){
+                uint64_t offset=size+buffer.size();
+                index.append((const char*)&offset,sizeof(offset));
+            }
+            encode_trace_record(parent.trace_format,(*trajectory)[i],buffer);
+        }
+    }
+    size+=buffer.size();
+
+    phase_scope timed(phase_t::submit);
+    _write(file,io_writer::op_t::append,std::move(buffer));
+    if(indexed)_write(file+".idx",io_writer::op_t::append,std::move(index));
+}
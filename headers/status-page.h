@@ -0,0 +1,176 @@
+#pragma once
+
+/**
+ * @file status-page.h
+ * @author karurochari
+ * @brief A memory mapped page in the workspace with the live progress of a run, to be polled by other processes.
+ * @version 0.1
+ * @date 2020-07-20
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "string-exception.h"
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<double>::is_always_lock_free);
+
+/**
+ * @brief The header of a status page, followed by one status_worker_t for each worker and one status_batch_t for each batch.
+ * Every field which changes during the run is a lock-free atomic, written with relaxed stores and no system call,
+ * so readers may see a slot half updated but never a torn value.
+ */
+struct alignas(64) status_header_t{
+    char                    magic[8];
+    uint32_t                version;
+    uint32_t                workers;
+    uint32_t                batches;
+    uint32_t                reserved=0;
+    std::atomic<uint64_t>   pid;
+    std::atomic<uint64_t>   started_ns;         ///< On the steady clock, shared by all the processes of the machine.
+    std::atomic<uint64_t>   updated_ns;         ///< The last checkpoint, completion or failure of any worker, or the creation of the page.
+    std::atomic<uint64_t>   total;              ///< The instances of the run.
+    std::atomic<uint64_t>   queued;             ///< The instances not yet started.
+    std::atomic<uint64_t>   completed;
+    std::atomic<uint64_t>   failed;
+    std::atomic<uint64_t>   finished_ns;        ///< When the run was over, 0 while it is running.
+};
+
+/**
+ * @brief A worker, alone on its cache line so that workers never share one.
+ */
+struct alignas(64) status_worker_t{
+    std::atomic<uint64_t>   batch;              ///< The index of the batch of the current instance.
+    std::atomic<uint64_t>   instance;           ///< The current instance, or idle.
+    std::atomic<uint64_t>   steps;              ///< The steps of the current instance.
+    std::atomic<double>     rate;               ///< Steps per second, measured between the last two checkpoints.
+    std::atomic<uint64_t>   completed;
+    std::atomic<uint64_t>   failed;
+    std::atomic<uint64_t>   updated_ns;         ///< The last checkpoint, completion or failure, 0 before the first one.
+};
+
+struct alignas(64) status_batch_t{
+    char                    name[56];           ///< Truncated when longer.
+    uint64_t                instances;
+};
+
+/**
+ * @brief The status page of a run, created by the runner or opened read-only by an observer.
+ */
+struct status_page{
+    static constexpr char       magic[8]={'S','S','A','G','I','S','T','P'};
+    static constexpr uint32_t   version=1;
+    static constexpr uint64_t   idle=std::numeric_limits<uint64_t>::max();     ///< The instance of a worker not running any.
+
+    static inline size_t size(uint workers, uint batches){return sizeof(status_header_t)+workers*sizeof(status_worker_t)+batches*sizeof(status_batch_t);}
+
+    static inline uint64_t now_ns(){return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();}
+
+    status_page()=default;
+    status_page(const status_page&)=delete;
+    status_page(status_page&& o){*this=std::move(o);}
+
+    status_page& operator=(status_page&& o){
+        _unmap();
+        region=o.region;
+        region_size=o.region_size;
+        o.region=nullptr;
+        o.region_size=0;
+        return *this;
+    }
+
+    ~status_page(){_unmap();}
+
+    /**
+     * @brief Create the page, replacing the one of a previous run.
+     * @param batches the names of the batches, with their number of instances.
+     */
+    static status_page create(const std::string& file, uint workers, const std::vector<std::pair<std::string,uint64_t>>& batches){
+        status_page ret;
+        const size_t n=size(workers,batches.size());
+        //The new page is built aside and renamed, so that observers never map a page being initialized.
+        const std::string tmp=file+".tmp";
+        int fd=::open(tmp.c_str(),O_RDWR|O_CREAT|O_TRUNC,0644);
+        if(fd<0)throw StringException("StatusPageException");
+        if(ftruncate(fd,n)!=0){close(fd);throw StringException("StatusPageException");}
+        ret._map(fd,n,true);
+        close(fd);
+
+        status_header_t* h=new(ret.region) status_header_t();
+        memcpy(h->magic,magic,sizeof(magic));
+        h->version=version;
+        h->workers=workers;
+        h->batches=batches.size();
+        h->pid=getpid();
+        h->started_ns=now_ns();
+        h->updated_ns=now_ns();
+        uint64_t total=0;
+        for(auto& b:batches)total+=b.second;
+        h->total=total;
+        h->queued=total;
+
+        for(uint i=0;i<workers;i++){
+            status_worker_t* w=new(&ret.worker(i)) status_worker_t();
+            w->instance=idle;
+        }
+        for(uint i=0;i<batches.size();i++){
+            status_batch_t* b=new(&ret.batch(i)) status_batch_t();
+            strncpy(b->name,batches[i].first.c_str(),sizeof(b->name)-1);
+            b->instances=batches[i].second;
+        }
+        if(rename(tmp.c_str(),file.c_str())!=0)throw StringException("StatusPageException");
+        return ret;
+    }
+
+    /**
+     * @brief Map the page of a run, read-only.
+     */
+    static status_page open(const std::string& file){
+        status_page ret;
+        int fd=::open(file.c_str(),O_RDONLY);
+        if(fd<0)throw StringException("StatusPageException");
+        struct stat st;
+        if(fstat(fd,&st)!=0 || (size_t)st.st_size<sizeof(status_header_t)){close(fd);throw StringException("StatusPageException");}
+        ret._map(fd,st.st_size,false);
+        close(fd);
+
+        const status_header_t& h=ret.header();
+        if(memcmp(h.magic,magic,sizeof(magic))!=0 || h.version!=version || size(h.workers,h.batches)>(size_t)st.st_size)throw StringException("StatusPageException");
+        return ret;
+    }
+
+    inline bool valid() const{return region!=nullptr;}
+
+    inline status_header_t& header() const{return *(status_header_t*)region;}
+    inline status_worker_t& worker(uint i) const{return ((status_worker_t*)((char*)region+sizeof(status_header_t)))[i];}
+    inline status_batch_t& batch(uint i) const{return ((status_batch_t*)((char*)region+sizeof(status_header_t)+header().workers*sizeof(status_worker_t)))[i];}
+
+    private:
+        void*   region=nullptr;
+        size_t  region_size=0;
+
+        void _map(int fd, size_t n, bool writable){
+            region=mmap(nullptr,n,writable?PROT_READ|PROT_WRITE:PROT_READ,MAP_SHARED,fd,0);
+            if(region==MAP_FAILED){region=nullptr;close(fd);throw StringException("StatusPageException");}
+            region_size=n;
+        }
+
+        void _unmap(){
+            if(region!=nullptr)munmap(region,region_size);
+            region=nullptr;
+        }
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+/**
+ * @file task-arena.h
+ * @author karurochari
+ * @brief Memory arenas for what lives as long as an instance, recycled by the next ones.
+ * @version 0.1
+ * @date 2020-07-28
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+#include <mutex>
+#include <cstddef>
+#include <algorithm>
+
+#include "workers-queue.h"
+
+/**
+ * @brief A resource forwarding to another one, keeping track of the bytes it holds.
+ */
+struct counting_resource : std::pmr::memory_resource{
+    counting_resource(std::pmr::memory_resource* _upstream):upstream(_upstream){}
+
+    inline size_t live() const{return _live;}
+    inline size_t peak() const{return _peak;}
+    inline void reset_peak(){_peak=_live;}
+
+    private:
+        std::pmr::memory_resource*  upstream;
+        size_t                      _live=0;
+        size_t                      _peak=0;
+
+        void* do_allocate(size_t bytes, size_t alignment) override{
+            void* ret=upstream->allocate(bytes,alignment);
+            _live+=bytes;
+            _peak=std::max(_peak,_live);
+            return ret;
+        }
+
+        void do_deallocate(void* p, size_t bytes, size_t alignment) override{
+            upstream->deallocate(p,bytes,alignment);
+            _live-=bytes;
+        }
+
+        bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override{return this==&o;}
+};
+
+/**
+ * @brief The arena of an instance: a pool of blocks reused as they are freed, carved out of a buffer allocated in advance.
+ * When the buffer is not enough more memory is taken from the heap, and the buffer is grown to match once the instance is over, so that the next ones do not need to.
+ * It is not synchronized, as only one thread at a time runs an instance.
+ * Allocations larger than the largest block of the pool are only given back when the instance is over.
+ */
+struct task_arena{
+    task_arena(size_t initial):blocks(std::pmr::new_delete_resource()){_build(initial);}
+    task_arena(const task_arena&)=delete;
+
+    inline std::pmr::memory_resource* resource(){return &*pool;}
+
+    /**
+     * @brief The most memory taken from the system since the last reset, buffer included.
+     */
+    inline size_t footprint() const{return buffer_size+blocks.peak();}
+
+    /**
+     * @brief Free everything at once, growing the buffer to the footprint reached so far.
+     */
+    void reset(){
+        const size_t need=footprint();
+        pool->release();
+        monotonic->release();
+        if(need>buffer_size)_build(need);
+        blocks.reset_peak();
+    }
+
+    private:
+        counting_resource                                       blocks;         ///< The memory taken beyond the buffer.
+        std::unique_ptr<std::byte[]>                            buffer;
+        size_t                                                  buffer_size=0;
+        std::optional<std::pmr::monotonic_buffer_resource>      monotonic;
+        std::optional<std::pmr::unsynchronized_pool_resource>   pool;
+
+        void _build(size_t size){
+            pool.reset();
+            monotonic.reset();
+            buffer.reset(new std::byte[size]);
+            buffer_size=size;
+            monotonic.emplace(buffer.get(),buffer_size,&blocks);
+            pool.emplace(std::pmr::pool_options{0,4<<20},&*monotonic);
+        }
+};
+
+/**
+ * @brief The arenas of the instances running, reset and recycled once they are over.
+ * There are never more arenas than instances in flight at once, which with the plain queue means one for each worker.
+ * The footprint of the arenas is recorded for the worker where each instance ended.
+ */
+struct arena_pool{
+    /**
+     * @brief Gives its arena back to the pool when the instance is over.
+     */
+    struct release_t{
+        arena_pool* pool=nullptr;
+        void operator()(task_arena* a) const{
+            if(pool!=nullptr)pool->_release(a);
+            else delete a;
+        }
+    };
+
+    typedef std::unique_ptr<task_arena,release_t> handle_t;
+
+    size_t  initial=256<<10;    ///< The buffer of a new arena, in bytes.
+
+    arena_pool()=default;
+    arena_pool(const arena_pool&)=delete;
+
+    handle_t acquire(){
+        std::unique_ptr<task_arena> a;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if(!spare.empty()){
+                a=std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        if(!a)a=std::make_unique<task_arena>(initial);
+        return handle_t(a.release(),release_t{this});
+    }
+
+    /**
+     * @brief The largest footprint of an arena on each worker.
+     */
+    std::vector<size_t> peaks() const{
+        std::lock_guard<std::mutex> lock(m);
+        return _peaks;
+    }
+
+    private:
+        mutable std::mutex                          m;
+        std::vector<std::unique_ptr<task_arena>>    spare;
+        std::vector<size_t>                         _peaks;
+
+        void _release(task_arena* a){
+            const size_t footprint=a->footprint();
+            a->reset();
+            std::lock_guard<std::mutex> lock(m);
+            if(_peaks.size()<=this_worker)_peaks.resize(this_worker+1,0);
+            _peaks[this_worker]=std::max(_peaks[this_worker],footprint);
+            spare.emplace_back(a);
+        }
+};
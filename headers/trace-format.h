@@ -0,0 +1,179 @@
+#pragma once
+
+/**
+ * @file trace-format.h
+ * @author karurochari
+ * @brief Encodings for the trace files and a seekable reader for the binary ones.
+ * @version 0.1
+ * @date 2020-06-22
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <string>
+#include <vector>
+#include <span>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <nlohmann/json.hpp>
+
+#include "string-exception.h"
+#include "json-writer.h"
+
+/**
+ * @brief How each record of a trace is encoded.
+ * `json` is the legacy text format, records separated by 0x1F.
+ * All the others are binary: each record is prefixed by its length as a 32bit little-endian integer, and a sidecar `.idx` file stores the 64bit offset of each record.
+ */
+enum class trace_format_t{json, cbor, msgpack, raw};
+
+inline bool trace_format_from_string(const std::string& s, trace_format_t& f){
+    if(s=="json")f=trace_format_t::json;
+    else if(s=="cbor")f=trace_format_t::cbor;
+    else if(s=="msgpack")f=trace_format_t::msgpack;
+    else if(s=="raw")f=trace_format_t::raw;
+    else return false;
+    return true;
+}
+
+/**
+ * @brief Append the length prefix of a binary record.
+ */
+inline void _trace_length_prefix(std::string& out, uint32_t len){
+    for(uint i=0;i<4;i++)out.push_back((char)((len>>(8*i))&0xff));
+}
+
+/**
+ * @brief Append a single record to a buffer, with its framing.
+ * @param f the encoding to be used.
+ * @param d the record.
+ * @param out where the encoded bytes are appended.
+ */
+template<typename D>
+void encode_trace_record(trace_format_t f, const D& d, std::string& out){
+    if(f==trace_format_t::raw){
+        if constexpr(std::is_trivially_copyable_v<D>){
+            _trace_length_prefix(out,sizeof(D));
+            out.append((const char*)&d,sizeof(D));
+            return;
+        }
+        else throw StringException("UnsupportedTraceFormatException");
+    }
+
+    if(f==trace_format_t::json){
+        json_writer w(out);
+        write_json(w,d);
+        out.push_back((char)31);   //Divide the unit of a record.
+    }
+    else{
+        nlohmann::json tmp;
+        to_json(tmp,d);
+        std::vector<uint8_t> bytes=(f==trace_format_t::cbor)?nlohmann::json::to_cbor(tmp):nlohmann::json::to_msgpack(tmp);
+        _trace_length_prefix(out,bytes.size());
+        out.append((const char*)bytes.data(),bytes.size());
+    }
+}
+
+/**
+ * @brief Read only access to a binary trace and its index, both memory mapped.
+ * Any record can be reached in constant time:
+ * ```
+ * trace_reader r("workspace/tasks/a/0/trace",trace_format_t::cbor);
+ * nlohmann::json step_k=r.json(k);
+ * ```
+ */
+struct trace_reader{
+    trace_reader(const std::string& file, trace_format_t f):format(f){
+        if(f==trace_format_t::json)throw StringException("UnsupportedTraceFormatException");
+        //Each mapping is released on its own, so nothing leaks if the second one fails.
+        data=mapping_t(file);
+        index=mapping_t(file+".idx");
+    }
+
+    trace_reader(const trace_reader&)=delete;
+
+    /**
+     * @brief The number of records in the trace.
+     */
+    inline size_t size() const{return index.size/sizeof(uint64_t);}
+
+    /**
+     * @brief The payload of the k-th record, without its length prefix.
+     */
+    std::span<const uint8_t> record(size_t k) const{
+        if(k>=size())throw StringException("TraceIndexOutOfRangeException");
+        uint64_t off;
+        memcpy(&off,index.data+k*sizeof(uint64_t),sizeof(off));
+        if(off+4>data.size)throw StringException("CorruptedTraceException");
+        uint32_t len=0;
+        for(uint i=0;i<4;i++)len|=((uint32_t)data.data[off+i])<<(8*i);
+        if(off+4+len>data.size)throw StringException("CorruptedTraceException");
+        return {data.data+off+4,len};
+    }
+
+    /**
+     * @brief Decode the k-th record of a cbor or msgpack trace.
+     */
+    nlohmann::json json(size_t k) const{
+        auto r=record(k);
+        if(format==trace_format_t::cbor)return nlohmann::json::from_cbor(r.begin(),r.end());
+        else if(format==trace_format_t::msgpack)return nlohmann::json::from_msgpack(r.begin(),r.end());
+        else throw StringException("UnsupportedTraceFormatException");
+    }
+
+    /**
+     * @brief Decode the k-th record of a raw trace.
+     */
+    template<typename D>
+    D raw(size_t k) const{
+        static_assert(std::is_trivially_copyable_v<D>);
+        auto r=record(k);
+        if(format!=trace_format_t::raw || r.size()!=sizeof(D))throw StringException("UnsupportedTraceFormatException");
+        D d;
+        memcpy(&d,r.data(),sizeof(D));
+        return d;
+    }
+
+    private:
+        /**
+         * @brief A read only mapping of a whole file, unmapped when destroyed.
+         */
+        struct mapping_t{
+            const uint8_t*  data=nullptr;
+            size_t          size=0;
+
+            mapping_t()=default;
+            mapping_t(const std::string& file){
+                int fd=open(file.c_str(),O_RDONLY);
+                if(fd<0)throw StringException("TraceOpenException");
+                struct stat st;
+                fstat(fd,&st);
+                if(st.st_size==0){close(fd);return;}
+                void* p=mmap(nullptr,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+                close(fd);
+                if(p==MAP_FAILED)throw StringException("TraceMapException");
+                data=(const uint8_t*)p;
+                size=st.st_size;
+            }
+            mapping_t(const mapping_t&)=delete;
+            mapping_t& operator=(mapping_t&& o){
+                std::swap(data,o.data);
+                std::swap(size,o.size);
+                return *this;
+            }
+            ~mapping_t(){if(data!=nullptr)munmap((void*)data,size);}
+        };
+
+        trace_format_t  format;
+        mapping_t       data;
+        mapping_t       index;
+};
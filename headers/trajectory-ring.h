@@ -0,0 +1,108 @@
+#pragma once
+
+/**
+ * @file trajectory-ring.h
+ * @author karurochari
+ * @brief A bounded buffer for the records of a trajectory, and a pool recycling them across instances.
+ * @version 0.1
+ * @date 2020-07-27
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstddef>
+#include <algorithm>
+
+/**
+ * @brief A buffer of records with a bounded capacity, emptied as a whole once its records are in the backup trace.
+ * Its storage is reserved for the whole capacity when it is reset, and kept when it is emptied or recycled, so that pushing records never allocates.
+ * Callers should bound the capacity by what the ring can actually hold before it is emptied.
+ * @tparam T the type of the records, which must be copy constructible.
+ */
+template <typename T>
+struct trajectory_ring{
+    trajectory_ring()=default;
+    trajectory_ring(const trajectory_ring&)=delete;
+
+    /**
+     * @brief Empty the ring and set its capacity, reserving the storage for it unless it already has enough.
+     */
+    void reset(size_t _capacity){
+        capacity=std::max<size_t>(1,_capacity);
+        clear();
+        records.reserve(capacity);
+    }
+
+    /**
+     * @brief Add a record after the newest one. The ring must not be full.
+     */
+    inline void push_back(const T& record){records.push_back(record);}
+
+    /**
+     * @brief Forget all the records, keeping the storage.
+     */
+    inline void clear(){records.clear();}
+
+    inline const T& operator[](size_t i) const{return records[i];}
+    inline size_t size() const{return records.size();}
+    inline bool full() const{return records.size()>=capacity;}
+
+    private:
+        std::vector<T>  records;
+        size_t          capacity=1;
+};
+
+/**
+ * @brief The rings of the instances running, recycled once they are over.
+ * There are never more rings than instances in flight at once, so after the first ones their memory is only allocated again when an instance needs a larger capacity than any before it.
+ */
+template <typename T>
+struct trajectory_pool{
+    typedef trajectory_ring<T> ring_t;
+
+    /**
+     * @brief Gives its ring back to the pool when the instance is over.
+     */
+    struct release_t{
+        trajectory_pool* pool=nullptr;
+        void operator()(ring_t* r) const{
+            if(pool!=nullptr)pool->_release(r);
+            else delete r;
+        }
+    };
+
+    typedef std::unique_ptr<ring_t,release_t> handle_t;
+
+    trajectory_pool()=default;
+    trajectory_pool(const trajectory_pool&)=delete;
+
+    /**
+     * @brief An empty ring of a given capacity.
+     */
+    handle_t acquire(size_t capacity){
+        std::unique_ptr<ring_t> r;
+        {
+            std::lock_guard<std::mutex> lock(m);
+            if(!spare.empty()){
+                r=std::move(spare.back());
+                spare.pop_back();
+            }
+        }
+        if(!r)r=std::make_unique<ring_t>();
+        r->reset(capacity);
+        return handle_t(r.release(),release_t{this});
+    }
+
+    private:
+        std::mutex                          m;
+        std::vector<std::unique_ptr<ring_t>> spare;
+
+        void _release(ring_t* r){
+            std::lock_guard<std::mutex> lock(m);
+            spare.emplace_back(r);
+        }
+};
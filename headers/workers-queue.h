@@ -3,49 +3,67 @@
 /**
  * @file workers-queue.h
  * @author karurochari
- * @brief 
- * @version 0.1
+ * @brief
+ * @version 0.2
  * @date 2020-04-20
- * 
+ *
  * @copyright Copyright (c) 2020
- * 
+ *
  */
 
 #include <iostream>
 #include <functional>
 #include <stdexcept>
-#include <queue>
-#include <map>
+#include <deque>
+#include <vector>
+#include <memory>
 #include <thread>
+#include <mutex>
+#include <chrono>
 
 #include "string-exception.h"
+#include "phase-metrics.h"
+
+/**
+ * @brief The index of the pool worker running the calling thread.
+ * It is only meaningful while a workers_queue is running, and it can be used to address per-worker resources without locking.
+ */
+inline thread_local uint this_worker=0;
 
 template <typename T>
 struct workers_queue;
 
 
+/**
+ * @brief A fixed pool of long-lived workers fed by the task generator.
+ * Each worker claims a small chunk of tasks from the generator into its own deque, and once the generator is exhausted idle workers steal from the others.
+ * @tparam T the generator type, it must expose `begin()` and `end()` whose iterators dereference to a `std::function<int()>`.
+ */
 template <typename T>
 struct workers_queue{
     private:
-        struct thread_t;
+        struct job_t;
+        struct worker_t;
 
-        uint                        max_queue;          ///< The maximum number of concurrent threads to be excuted at any time.
-        uint                        active_n=0;         ///< The number of active tasks.
-        uint                        next_id=0;          ///< The next id to be used.
-        std::queue<uint>            remove_next;        ///< The id of the thread to be disabled.
-        std::map<uint,thread_t*>    threads;            ///< The container for all threads, both running and not.
+    public:
+        struct record_t;
 
-        std::condition_variable     cv;
-        std::mutex                  m;
+    private:
+        uint                                    max_queue;          ///< The number of workers in the pool.
+        uint                                    chunk;              ///< How many tasks a worker claims from the generator at once.
+        uint                                    next_id=0;          ///< The next id to be used.
+        std::vector<std::unique_ptr<worker_t>>  workers;            ///< The pool, one deque for each worker.
+        std::vector<record_t>                   records;            ///< The report of the completed tasks, if requested.
 
-    public:
-        workers_queue(uint l=1):max_queue(l){}
+        std::mutex                              feed_m;             ///< Guards the generator and next_id.
+        std::mutex                              report_m;           ///< Guards the report and the output streams.
 
-        ~workers_queue(){for(auto [i,j]:threads)delete j;}
+    public:
+        workers_queue(uint l=1, uint c=4):max_queue(l==0?1:l),chunk(c==0?1:c){}
 
         /**
          * @brief Start executing all the tasks on the queue, with a maximum at any time fixed.
-         * 
+         *
          * @param cc a reference to the generator of tasks to be iterated over.
          * @param keep_track should the library keep some information on the completed task to be used later on?
          * @param verbose should the function print a final report on the tasks performed?
@@ -55,74 +73,54 @@ struct workers_queue{
          */
         int operator()(const T& cc, bool keep_track=true, bool verbose=true, std::ostream& out=std::cout, std::ostream& err=std::cerr){
             uint bad_counter=0;
-
-            for(auto ii=cc.begin();ii!=cc.end() or active_n!=0;){
-
-                std::unique_lock<std::mutex> lock(m);
-                for(;active_n<max_queue && ii!=cc.end();++ii){
-                    auto& th=*(threads[next_id++]=new thread_t(next_id));
-                    th.exec()=std::move(*ii);
-                    
-                    active_n++;
-                    if(verbose)out<<"Started   ["<<th.id()<<"]\n";
-
-                    th.thread()=std::thread([&](thread_t* _myself){
-                        thread_t& myself=*_myself;
-                        try{
-                            auto start = std::chrono::system_clock::now();
-                            myself.ret_val()=myself.exec()();
-                            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now() - start);
-                            myself.duration()=duration.count();
-
-                        }
-                        /*catch(const std::exception& ex){
-                            myself.exception()=true;
-                            myself.exception_handle()=ex;
-                        }*/
-                        catch(...){
-                            myself.exception()=true;
-                        }
-
-                        {
-                            std::unique_lock<std::mutex> lock(m);
-                            remove_next.push(myself.id());
-                            lock.unlock();
-                            cv.notify_all();
-                        }
-
-                    },&th);
-                    th.thread().detach();
-                }
-
-                cv.wait(lock, [&](){return remove_next.size()!=0;});
-
-                for(;remove_next.size()!=0;){
-                    const auto delendo=threads.find(remove_next.front());
-                    const thread_t& th=*(delendo->second);
+            auto ii=cc.begin();
+            const auto ee=cc.end();
+
+            workers.clear();
+            for(uint i=0;i<max_queue;i++)workers.emplace_back(std::make_unique<worker_t>());
+
+            auto body=[&](uint self){
+                this_worker=self;
+                for(job_t job;;){
+                    {
+                        phase_scope idle(phase_t::idle);
+                        if(!_pop(self,job) && !_refill(self,job,ii,ee) && !_steal(self,job))break;
+                    }
 
                     if(verbose){
-                        if(th.exception()){
-                            /*if(th.exception_handle().has_value())err<<"Exception in task ["<<th.id()<<"]: "<<th.exception_handle().value().what()<<"\n";
-                            else */err<<"Exception in task ["<<th.id()<<"]\n";
-                        }
-                        else out<<"Completed ["<<th.id()<<"]\tin "<<th.duration()<<". Returned ["<<th.ret_val()<<"]\n";
+                        std::lock_guard<std::mutex> lock(report_m);
+                        out<<"Started   ["<<job.id<<"]\n";
                     }
-                    
-                    if(th.exception() or th.ret_val()!=0)bad_counter++;
 
-                    if(!keep_track){
-                        auto it=threads.find(th.id());
-                        delete it->second;
-                        threads.erase(it);
+                    record_t rec(job.id);
+                    try{
+                        phase_scope task(phase_t::task);
+                        auto start = std::chrono::steady_clock::now();
+                        rec.ret_val()=job.exec();
+                        auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+                        rec.duration()=duration.count();
                     }
+                    catch(...){
+                        rec.exception()=true;
+                    }
+                    job.exec=nullptr;
 
-                    remove_next.pop();
-                    active_n--;
+                    {
+                        std::lock_guard<std::mutex> lock(report_m);
+                        if(verbose){
+                            if(rec.exception())err<<"Exception in task ["<<rec.id()<<"]\n";
+                            else out<<"Completed ["<<rec.id()<<"]\tin "<<rec.duration()<<". Returned ["<<rec.ret_val()<<"]\n";
+                        }
+                        if(rec.exception() or rec.ret_val()!=0)bad_counter++;
+                        if(keep_track)records.push_back(rec);
+                    }
                 }
+            };
 
-                lock.unlock();
-                cv.notify_all();
-            }
+            std::vector<std::thread> threads;
+            threads.reserve(max_queue);
+            for(uint i=0;i<max_queue;i++)threads.emplace_back(body,i);
+            for(auto& t:threads)t.join();
 
             if(verbose && bad_counter!=0){
                 out<<"Queue completed. ["<<bad_counter<<"] tasks failed.";
@@ -131,11 +129,75 @@ struct workers_queue{
             return bad_counter;
         }
 
+        /**
+         * @brief The report of the tasks completed by the last run, only filled if keep_track was set.
+         */
+        inline const std::vector<record_t>& completed() const{return records;}
+
     private:
 
-        struct thread_t{
+        /**
+         * @brief Take the next task from the front of the worker own deque.
+         */
+        bool _pop(uint self, job_t& job){
+            worker_t& w=*workers[self];
+            std::lock_guard<std::mutex> lock(w.m);
+            if(w.jobs.empty())return false;
+            job=std::move(w.jobs.front());
+            w.jobs.pop_front();
+            return true;
+        }
+
+        /**
+         * @brief Claim up to chunk tasks from the generator. The first one is returned, the others are queued on the worker own deque.
+         */
+        template<typename IT, typename ET>
+        bool _refill(uint self, job_t& job, IT& ii, const ET& ee){
+            std::lock_guard<std::mutex> lock(feed_m);
+            if(!(ii!=ee))return false;
+
+            job.id=next_id++;
+            job.exec=*ii;
+            ++ii;
+
+            worker_t& w=*workers[self];
+            std::lock_guard<std::mutex> lock_w(w.m);
+            for(uint i=1;i<chunk && ii!=ee;i++,++ii){
+                w.jobs.push_back({next_id++,*ii});
+            }
+            return true;
+        }
+
+        /**
+         * @brief Take a task from the back of the deque of any other worker.
+         */
+        bool _steal(uint self, job_t& job){
+            for(uint i=1;i<max_queue;i++){
+                worker_t& w=*workers[(self+i)%max_queue];
+                std::lock_guard<std::mutex> lock(w.m);
+                if(w.jobs.empty())continue;
+                job=std::move(w.jobs.back());
+                w.jobs.pop_back();
+                return true;
+            }
+            return false;
+        }
+
+        struct job_t{
+            uint                            id=0;
+            std::function<int()>            exec;
+        };
+
+        struct worker_t{
+            std::mutex                      m;
+            std::deque<job_t>               jobs;
+        };
+
+    public:
+
+        struct record_t{
             public:
-                thread_t(uint i):_id(i){}
+                record_t(uint i):_id(i){}
 
                 inline uint id() const{return _id;}
 
@@ -148,18 +210,10 @@ struct workers_queue{
                 inline bool exception() const{return _exception;}
                 inline bool& exception() {return _exception;}
 
-                inline const std::thread& thread() const{return _thread;}
-                inline std::thread& thread() {return _thread;}
-
-                inline const std::function<int()>& exec() const{return _exec;}
-                inline std::function<int()>& exec() {return _exec;}
-
             private:
                 uint                            _id;
-                int                             _ret_val;
-                uint                            _duration;
+                int                             _ret_val=0;
+                uint                            _duration=0;
                 bool                            _exception=false;
-                std::thread                     _thread;
-                std::function<int()>            _exec;
         };
-};
\ No newline at end of file
+};
@@ -0,0 +1,166 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Check that batched models run in lanes reach the same results as one instance at a time, failing lanes included.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "simulator_t.h"
+
+using nlohmann::json;
+
+/**
+ * @brief A counter advanced by random increments, which fails with a given probability at each step.
+ * @tparam DIFFERENTIAL is it a differential model?
+ */
+template<bool DIFFERENTIAL>
+struct lane_model{
+    struct state_t{
+        uint64_t x=0;
+
+        friend void to_json(json& j, const state_t& s){j["x"]=s.x;}
+        friend void from_json(const json& j, state_t& s){s.x=j.value("x",(uint64_t)0);}
+
+        state_t& operator+=(const state_t& a){x+=a.x;return *this;}
+        state_t operator-(const state_t& a) const{return {x-a.x};}
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=100;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)100);}
+
+        bool operator()(const state_t& s) const{return s.x>=limit;}
+    };
+
+    double fail=0;
+
+    friend void to_json(json& j, const lane_model& m){j["fail"]=m.fail;}
+    friend void from_json(const json& j, lane_model& m){m.fail=j.value("fail",0.0);}
+
+    inline const static bool differential=DIFFERENTIAL;
+    inline const static bool recoverable=true;
+    inline const static bool batched=true;
+    inline const static uint lanes=4;
+
+    template<typename E>
+    uint64_t draw(const E& env) const{
+        if(env.rng().uniform()<fail)throw std::runtime_error("lane failure");
+        return 1+env.rng()()%3;
+    }
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        if constexpr(DIFFERENTIAL)return {draw(env)};
+        else return {s.x+draw(env)};
+    }
+
+    //Lanes are advanced one after the other, so a failure leaves the lanes before it already advanced.
+    template<typename E>
+    void operator()(std::span<delta_state_t> d, std::span<const state_t>, std::span<mstate_t>, std::span<const uint8_t> active, std::span<const E* const> env) const requires DIFFERENTIAL{
+        for(size_t i=0;i<d.size();i++)if(active[i])d[i]={draw(*env[i])};
+    }
+
+    template<typename E>
+    void operator()(std::span<state_t> s, std::span<mstate_t>, std::span<const uint8_t> active, std::span<const E* const> env) const requires (!DIFFERENTIAL){
+        for(size_t i=0;i<s.size();i++)if(active[i])s[i].x+=draw(*env[i]);
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+/**
+ * @brief Run a batch and return its manifest, sorted.
+ */
+template<typename M>
+static std::vector<std::string> run(const std::string& workspace, uint lanes){
+    json config={
+        {"workspace",workspace},
+        {"model",{{"fail",0.004}}},
+        {"parallel",2u},
+        {"seed",7u},
+        {"status-page",false},
+        {"tasks",{{"a",{{"end-condition",{{"limit",300u}}},{"instances",13u},{"lanes",lanes},{"sync",5u},{"backup",2u},{"trace-format","cbor"}}}}}
+    };
+    std::ostringstream out, err;
+    {
+        simulator_t<M,null_callback,null_tweaks> sim(config,out,err);
+        sim();
+    }
+
+    std::vector<std::string> ret;
+    std::ifstream in(workspace+"/manifest");
+    for(std::string line;std::getline(in,line);)ret.push_back(line);
+    std::sort(ret.begin(),ret.end());
+    return ret;
+}
+
+template<typename M>
+static int check(const std::string& name, const std::string& root){
+    auto single=run<M>(root+"/"+name+"-single",1);
+    auto batched=run<M>(root+"/"+name+"-batched",4);
+
+    size_t failed=std::count_if(single.begin(),single.end(),[](const std::string& l){return l.find("\t1\t")!=std::string::npos;});
+    if(single.size()!=13 || failed==0 || failed==single.size()){
+        std::cerr<<name<<": expected both completed and failed instances, got ["<<failed<<"] failed out of ["<<single.size()<<"].\n";
+        return 1;
+    }
+    if(single!=batched){
+        std::cerr<<name<<": the manifests of the single and batched runs differ.\n";
+        for(size_t i=0;i<std::max(single.size(),batched.size());i++){
+            std::cerr<<(i<single.size()?single[i]:"")<<"\t|\t"<<(i<batched.size()?batched[i]:"")<<"\n";
+        }
+        return 1;
+    }
+    for(uint i=0;i<13;i++){
+        const std::string task="/tasks/a/"+std::to_string(i)+"/trace";
+        std::ifstream a(root+"/"+name+"-single"+task,std::ios_base::binary), b(root+"/"+name+"-batched"+task,std::ios_base::binary);
+        std::string ta((std::istreambuf_iterator<char>(a)),std::istreambuf_iterator<char>()), tb((std::istreambuf_iterator<char>(b)),std::istreambuf_iterator<char>());
+        if(ta!=tb){
+            std::cerr<<name<<": the traces of instance ["<<i<<"] differ.\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(){
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-test-2-"+std::to_string(getpid()))).string();
+    int ret=0;
+    ret|=check<lane_model<true>>("differential",root);
+    ret|=check<lane_model<false>>("in-place",root);
+    std::filesystem::remove_all(root);
+    return ret;
+}
@@ -0,0 +1,157 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Check that with process isolation the instances of a model crashing with a segmentation fault are resumed, and reach the results of a run without crashes.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <algorithm>
+
+#include <csignal>
+#include <unistd.h>
+
+#include "simulator_t.h"
+
+using nlohmann::json;
+
+/**
+ * @brief A counter advanced by random increments, which crashes the first time it reaches some values.
+ * Each crash leaves a marker behind, so that the instance resumed from its backup goes past that value.
+ */
+struct crash_model{
+    struct state_t{
+        uint64_t x=0;
+
+        friend void to_json(json& j, const state_t& s){j["x"]=s.x;}
+        friend void from_json(const json& j, state_t& s){s.x=j.value("x",(uint64_t)0);}
+
+        state_t operator-(const state_t& a) const{return {x-a.x};}
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=100;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)100);}
+
+        bool operator()(const state_t& s) const{return s.x>=limit;}
+    };
+
+    std::string markers;    ///< Where the markers of the crashes are left, no crash if empty.
+    uint64_t    every=97;   ///< The values at which it crashes are the multiples of this.
+
+    friend void to_json(json& j, const crash_model& m){j["markers"]=m.markers;j["every"]=m.every;}
+    friend void from_json(const json& j, crash_model& m){m.markers=j.value("markers","");m.every=j.value("every",(uint64_t)97);}
+
+    inline const static bool differential=false;
+    inline const static bool recoverable=true;
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        if(!markers.empty() && s.x%every==0 && s.x!=0){
+            const std::string marker=markers+"/"+std::to_string(s.x);
+            if(!std::filesystem::exists(marker)){
+                std::ofstream(marker).put('x');
+                raise(SIGSEGV);
+            }
+        }
+        return {s.x+1+env.rng()()%3};
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+/**
+ * @brief Run a batch and return its manifest, sorted.
+ */
+static std::vector<std::string> run(const std::string& workspace, const std::string& markers){
+    json config={
+        {"workspace",workspace},
+        {"model",{{"markers",markers}}},
+        {"parallel",3u},
+        {"seed",11u},
+        {"status-page",false},
+        {"tasks",{{"a",{{"end-condition",{{"limit",400u}}},{"instances",9u},{"sync",4u},{"backup",1u},{"trace-format","cbor"}}}}}
+    };
+    if(!markers.empty()){
+        config["isolation"]="process";
+        config["retries"]=20u;
+    }
+    std::ostringstream out, err;
+    {
+        simulator_t<crash_model,null_callback,null_tweaks> sim(config,out,err);
+        sim();
+    }
+
+    std::vector<std::string> ret;
+    std::ifstream in(workspace+"/manifest");
+    for(std::string line;std::getline(in,line);)ret.push_back(line);
+    std::sort(ret.begin(),ret.end());
+    return ret;
+}
+
+int main(){
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-test-3-"+std::to_string(getpid()))).string();
+    const std::string markers=root+"/markers";
+    std::filesystem::create_directories(markers);
+
+    auto reference=run(root+"/threads","");
+    auto crashed=run(root+"/processes",markers);
+
+    int ret=0;
+    const size_t crashes=std::distance(std::filesystem::directory_iterator(markers),std::filesystem::directory_iterator());
+    if(crashes==0){
+        std::cerr<<"The model never crashed.\n";
+        ret=1;
+    }
+    size_t failed=std::count_if(reference.begin(),reference.end(),[](const std::string& l){return l.find("\t0\t")==std::string::npos;});
+    if(reference.size()!=9 || failed!=0){
+        std::cerr<<"The reference run did not complete all its instances.\n";
+        ret=1;
+    }
+    if(reference!=crashed){
+        std::cerr<<"The manifests of the runs with and without crashes differ.\n";
+        for(size_t i=0;i<std::max(reference.size(),crashed.size());i++){
+            std::cerr<<(i<reference.size()?reference[i]:"")<<"\t|\t"<<(i<crashed.size()?crashed[i]:"")<<"\n";
+        }
+        ret=1;
+    }
+    for(uint i=0;i<9 && ret==0;i++){
+        const std::string task="/tasks/a/"+std::to_string(i)+"/trace";
+        std::ifstream a(root+"/threads"+task,std::ios_base::binary), b(root+"/processes"+task,std::ios_base::binary);
+        std::string ta((std::istreambuf_iterator<char>(a)),std::istreambuf_iterator<char>()), tb((std::istreambuf_iterator<char>(b)),std::istreambuf_iterator<char>());
+        if(ta!=tb){
+            std::cerr<<"The traces of instance ["<<i<<"] differ.\n";
+            ret=1;
+        }
+    }
+    if(ret==0)std::cout<<"["<<crashes<<"] crashes survived.\n";
+    std::filesystem::remove_all(root);
+    return ret;
+}
@@ -0,0 +1,203 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Check that the instances of a distributed run are completed once, with the results of a local run, when a worker is killed or stalls past its lease.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+
+#include <csignal>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "simulator_t.h"
+
+using nlohmann::json;
+
+/**
+ * @brief A counter advanced by random increments, taking a millisecond for each step so that the instances are still running when a worker is stopped.
+ */
+struct slow_model{
+    struct state_t{
+        uint64_t x=0;
+
+        friend void to_json(json& j, const state_t& s){j["x"]=s.x;}
+        friend void from_json(const json& j, state_t& s){s.x=j.value("x",(uint64_t)0);}
+
+        state_t operator-(const state_t& a) const{return {x-a.x};}
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=100;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)100);}
+
+        bool operator()(const state_t& s) const{return s.x>=limit;}
+    };
+
+    uint ms=0;  ///< How long each step takes.
+
+    friend void to_json(json& j, const slow_model& m){j["ms"]=m.ms;}
+    friend void from_json(const json& j, slow_model& m){m.ms=j.value("ms",0u);}
+
+    inline const static bool differential=false;
+    inline const static bool recoverable=true;
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        if(ms!=0)std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        return {s.x+1+env.rng()()%3};
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+typedef simulator_t<slow_model,null_callback,null_tweaks> sim_t;
+
+static constexpr uint instances=6;
+static constexpr uint lease_ms=400;
+
+static json configuration(const std::string& workspace){
+    return {
+        {"workspace",workspace},
+        {"model",{{"ms",1u}}},
+        {"parallel",1u},
+        {"seed",5u},
+        {"status-page",false},
+        {"tasks",{{"a",{{"end-condition",{{"limit",240u}}},{"instances",instances},{"sync",4u},{"backup",1u},{"trace-format","cbor"}}}}}
+    };
+}
+
+static std::vector<std::string> manifest(const std::string& workspace){
+    std::vector<std::string> ret;
+    std::ifstream in(workspace+"/manifest");
+    for(std::string line;std::getline(in,line);)ret.push_back(line);
+    std::sort(ret.begin(),ret.end());
+    return ret;
+}
+
+static std::string trace(const std::string& workspace, uint i){
+    std::ifstream in(workspace+"/tasks/a/"+std::to_string(i)+"/trace",std::ios_base::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Run the batch with a coordinator and two workers, and send the signals to the first worker once it is running.
+ * @param signals the signals to send, one after the other, with the delay before each of them.
+ */
+static void distributed(const std::string& workspace, const std::string& address, const std::vector<std::pair<int,uint>>& signals){
+    json config=configuration(workspace);
+    config["distributed"]={{"role","coordinator"},{"address",address},{"chunk",1u},{"lease-ms",lease_ms}};
+    std::ostringstream out, err;
+    pid_t workers[2];
+    {
+        //The coordinator creates the workspace, before the workers join it.
+        sim_t sim(config,out,err);
+        for(auto& pid:workers){
+            pid=fork();
+            if(pid==0){
+                json worker_config=configuration(workspace);
+                worker_config["distributed"]={{"role","worker"},{"address",address},{"lease-ms",lease_ms}};
+                std::ostringstream worker_out, worker_err;
+                try{
+                    sim_t worker(worker_config,worker_out,worker_err);
+                    worker();
+                }
+                catch(...){
+                    _exit(1);
+                }
+                _exit(0);
+            }
+        }
+
+        std::thread signaller([&](){
+            for(auto& [sig,ms]:signals){
+                std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+                kill(workers[0],sig);
+            }
+        });
+        sim();
+        signaller.join();
+    }
+    for(auto pid:workers){
+        int status;
+        waitpid(pid,&status,0);
+    }
+}
+
+static int check(const std::string& name, const std::string& root, const std::string& reference, const std::vector<std::pair<int,uint>>& signals){
+    const std::string workspace=root+"/"+name;
+    distributed(workspace,"unix:"+root+"/"+name+".socket",signals);
+
+    auto expected=manifest(reference);
+    auto got=manifest(workspace);
+    if(expected!=got){
+        std::cerr<<name<<": the manifests of the local and distributed runs differ.\n";
+        for(size_t i=0;i<std::max(expected.size(),got.size());i++){
+            std::cerr<<(i<expected.size()?expected[i]:"")<<"\t|\t"<<(i<got.size()?got[i]:"")<<"\n";
+        }
+        return 1;
+    }
+    for(uint i=0;i<instances;i++){
+        if(trace(reference,i)!=trace(workspace,i)){
+            std::cerr<<name<<": the traces of instance ["<<i<<"] differ.\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(){
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-test-4-"+std::to_string(getpid()))).string();
+    std::filesystem::create_directories(root);
+
+    {
+        std::ostringstream out, err;
+        sim_t sim(configuration(root+"/local"),out,err);
+        sim();
+    }
+    auto reference=manifest(root+"/local");
+    if(reference.size()!=instances || std::any_of(reference.begin(),reference.end(),[](const std::string& l){return l.find("\t0\t")==std::string::npos;})){
+        std::cerr<<"The local run did not complete all its instances.\n";
+        std::filesystem::remove_all(root);
+        return 1;
+    }
+
+    int ret=0;
+    //A worker killed in the middle of an instance, which the other one resumes.
+    ret|=check("killed",root,root+"/local",{{SIGKILL,120}});
+    //A worker frozen past its lease while the other one resumes its instance, and woken up before it is over: it must not write anything else.
+    ret|=check("stalled",root,root+"/local",{{SIGSTOP,120},{SIGCONT,3*lease_ms}});
+    std::filesystem::remove_all(root);
+    return ret;
+}
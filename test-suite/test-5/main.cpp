@@ -0,0 +1,140 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Check that an adaptive batch converges after a small part of its instances, rather than once all of them are done, even when one of them fails to start.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <array>
+#include <span>
+
+#include <unistd.h>
+
+#include "simulator_t.h"
+
+using nlohmann::json;
+
+/**
+ * @brief A counter advanced by random increments, whose value is its only observable.
+ */
+struct walk_model{
+    struct state_t{
+        uint64_t x=0;
+
+        friend void to_json(json& j, const state_t& s){j["x"]=s.x;}
+        friend void from_json(const json& j, state_t& s){s.x=j.value("x",(uint64_t)0);}
+
+        state_t operator-(const state_t& a) const{return {x-a.x};}
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=100;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)100);}
+
+        bool operator()(const state_t& s) const{return s.x>=limit;}
+    };
+
+    friend void to_json(json&, const walk_model&){}
+    friend void from_json(const json&, walk_model&){}
+
+    inline const static bool differential=false;
+    inline const static bool recoverable=true;
+
+    inline static const std::array<const char*,1> observables={"x"};
+    void observe(const state_t& s, std::span<double> o) const{o[0]=(double)s.x;}
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        return {s.x+1+env.rng()()%1000};
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+typedef simulator_t<walk_model,null_callback,null_tweaks> sim_t;
+
+static constexpr uint instances=400;
+
+/**
+ * @brief Run the adaptive batch in a new workspace.
+ * @param blocked if set, a file takes the place of the directory of an early instance, so that it fails before starting.
+ * @return the number of instances completed.
+ */
+static uint completed(const std::string& workspace, bool blocked=false){
+    if(blocked){
+        std::filesystem::create_directories(workspace+"/tasks/a");
+        std::ofstream(workspace+"/tasks/a/3")<<"blocked";
+    }
+    json config={
+        {"workspace",workspace},
+        {"model",json::object()},
+        {"parallel",4u},
+        {"seed",7u},
+        {"continue",blocked},
+        {"status-page",false},
+        {"tasks",{{"a",{{"end-condition",{{"limit",20000u}}},{"instances",instances},{"sync",50u},{"backup",2u},
+            {"adaptive",{{"observable","x"},{"width",0.02},{"min-instances",10u}}}}}}}
+    };
+    {
+        std::ostringstream out, err;
+        sim_t sim(config,out,err);
+        sim();
+    }
+    uint ret=0;
+    std::ifstream in(workspace+"/manifest");
+    for(std::string line;std::getline(in,line);)ret+=line.find("\t0\t")!=std::string::npos?1:0;
+    return ret;
+}
+
+int main(){
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-test-5-"+std::to_string(getpid()))).string();
+    std::filesystem::create_directories(root);
+
+    int ret=0;
+    const uint first=completed(root+"/first");
+    //Only the instances already running when the estimate converges complete after it, a few for each worker.
+    if(first<10 || first>instances/4){
+        std::cerr<<"The batch completed ["<<first<<"] of its ["<<instances<<"] instances.\n";
+        ret=1;
+    }
+    const uint second=completed(root+"/second");
+    if(second<10 || second>instances/4){
+        std::cerr<<"The second run of the batch completed ["<<second<<"] of its ["<<instances<<"] instances.\n";
+        ret=1;
+    }
+    //The estimate skips an instance failing while it is being resumed, instead of waiting for it.
+    const uint blocked=completed(root+"/blocked",true);
+    if(blocked<10 || blocked>instances/4){
+        std::cerr<<"With an instance failing to start, the batch completed ["<<blocked<<"] of its ["<<instances<<"] instances.\n";
+        ret=1;
+    }
+    std::filesystem::remove_all(root);
+    return ret;
+}
@@ -0,0 +1,142 @@
+/**
+ * @file main.cpp
+ * @author karurochari
+ * @brief Check that an instance failing mid-run and continued ends with the trace of a run without failures, when it resumes from its last sync, from its backup, or starts over as neither is valid.
+ * @version 0.1
+ * @date 2020-07-30
+ *
+ * @copyright Copyright (c) 2020
+ *
+ */
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <functional>
+#include <stdexcept>
+
+#include <unistd.h>
+
+#include "simulator_t.h"
+
+using nlohmann::json;
+
+/**
+ * @brief A counter advanced by random increments, which can be made to fail at a given step.
+ */
+struct failing_model{
+    struct state_t{
+        uint64_t x=0;
+        uint64_t n=0;   ///< The steps taken.
+
+        friend void to_json(json& j, const state_t& s){j["x"]=s.x;j["n"]=s.n;}
+        friend void from_json(const json& j, state_t& s){s.x=j.value("x",(uint64_t)0);s.n=j.value("n",(uint64_t)0);}
+
+        state_t operator-(const state_t& a) const{return {x-a.x,n-a.n};}
+    };
+
+    struct mstate_t{
+        friend void to_json(json&, const mstate_t&){}
+        friend void from_json(const json&, mstate_t&){}
+    };
+
+    typedef state_t delta_state_t;
+
+    struct termination_t{
+        uint64_t limit=100;
+
+        friend void to_json(json& j, const termination_t& t){j["limit"]=t.limit;}
+        friend void from_json(const json& j, termination_t& t){t.limit=j.value("limit",(uint64_t)100);}
+
+        bool operator()(const state_t& s) const{return s.x>=limit;}
+    };
+
+    inline static uint64_t fail_at=0;   ///< The step at which the model fails, none if 0.
+
+    friend void to_json(json&, const failing_model&){}
+    friend void from_json(const json&, failing_model&){}
+
+    inline const static bool differential=false;
+    inline const static bool recoverable=true;
+
+    template<typename E>
+    state_t operator()(const state_t& s, mstate_t&, const E& env) const{
+        if(fail_at!=0 && s.n==fail_at)throw std::runtime_error("Failing on purpose");
+        return {s.x+1+env.rng()()%3,s.n+1};
+    }
+};
+
+struct null_callback{
+    friend void from_json(const json&, null_callback&){}
+
+    template<typename T>
+    void operator()(const T&) const{}
+};
+
+struct null_tweaks{
+    friend void from_json(const json&, null_tweaks&){}
+};
+
+typedef simulator_t<failing_model,null_callback,null_tweaks> sim_t;
+
+static void run(const std::string& workspace, bool continue_mode){
+    json config={
+        {"workspace",workspace},
+        {"model",json::object()},
+        {"parallel",1u},
+        {"seed",11u},
+        {"status-page",false},
+        {"continue",continue_mode},
+        {"tasks",{{"a",{{"end-condition",{{"limit",200u}}},{"instances",1u},{"sync",4u},{"backup",1u},{"trace-format","cbor"}}}}}
+    };
+    std::ostringstream out, err;
+    sim_t sim(config,out,err);
+    sim();
+}
+
+static std::string content(const std::string& file){
+    std::ifstream in(file,std::ios_base::binary);
+    return std::string((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+}
+
+/**
+ * @brief Fail the instance at step 37, damage what it left, and continue it.
+ */
+static int check(const std::string& name, const std::string& root, const std::function<void(const std::string&)>& damage){
+    const std::string workspace=root+"/"+name;
+    failing_model::fail_at=37;
+    run(workspace,false);
+    failing_model::fail_at=0;
+    damage(workspace+"/tasks/a/0");
+    run(workspace,true);
+
+    for(const std::string file:{"trace","trace.idx"}){
+        if(content(root+"/reference/tasks/a/0/"+file)!=content(workspace+"/tasks/a/0/"+file)){
+            std::cerr<<name<<": the ["<<file<<"] differs from the one of a run without failures.\n";
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(){
+    const std::string root=(std::filesystem::temp_directory_path()/("ssagi-test-6-"+std::to_string(getpid()))).string();
+    std::filesystem::create_directories(root);
+    run(root+"/reference",false);
+
+    int ret=0;
+    ret|=check("last-sync",root,[](const std::string&){});
+    //The last generation is lost, so it resumes from the backup one.
+    ret|=check("backup",root,[](const std::string& dir){
+        std::ofstream(dir+"/checkpoint")<<"garbage";
+    });
+    //The trace is cut below what both generations recorded, so neither is valid and the instance starts over.
+    ret|=check("start-over",root,[](const std::string& dir){
+        const uint64_t bytes=json::parse(content(dir+"/checkpoint.copy")).value("trace",(uint64_t)0);
+        std::filesystem::resize_file(dir+"/trace",bytes/2);
+    });
+    std::filesystem::remove_all(root);
+    return ret;
+}